@@ -0,0 +1,113 @@
+#include "batcher.h"
+#include "core.h"
+#include "tensor.h"
+
+using namespace cinrt::model;
+
+Batcher::Batcher(Model* model, size_t maxBatchSize, std::chrono::microseconds maxWait)
+  : _model(model), _maxBatchSize(maxBatchSize > 0 ? maxBatchSize : 1), _maxWait(maxWait) {
+  const TensorInfo& input = _model->getInputs().front();
+  const TensorInfo& output = _model->getOutputs().front();
+  if (input.shape.empty() || input.shape[0] >= 0)
+    throw std::runtime_error("Batching needs a dynamic batch dimension on input " + input.name);
+  if (output.shape.empty() || output.shape[0] >= 0)
+    throw std::runtime_error("Output " + output.name + " has no batch dimension to split");
+  // Named apart from the input batch, so dim 0 counts rows rather than images.
+  std::string batch = input.symbols.empty() ? std::string() : input.symbols[0];
+  std::string rows = output.symbols.empty() ? std::string() : output.symbols[0];
+  if (!rows.empty() && rows != batch){
+    if (output.shape.size() != 2)
+      throw std::runtime_error("Output " + output.name + " is neither batch-major nor rows with a batch index");
+    _batchIndex = true;
+  }
+  _worker = std::thread(&Batcher::loop, this);
+}
+
+Batcher::~Batcher(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  if (_worker.joinable())
+    _worker.join();
+}
+
+std::future<std::shared_ptr<std::vector<Ort::Value>>> Batcher::submit(const Ort::Value& inputs){
+  auto info = inputs.GetTensorTypeAndShapeInfo();
+  Request request{cloneTensor(inputs, _allocator), info.GetShape(), info.GetElementType(), {}, std::chrono::steady_clock::now()};
+  if (request.shape.empty())
+    throw std::runtime_error("Batched input must have a batch dimension");
+  std::future<std::shared_ptr<std::vector<Ort::Value>>> result = request.promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stop)
+      throw std::runtime_error("Batcher is stopped");
+    _queuedRows += request.shape[0];
+    _queue.push_back(std::move(request));
+  }
+  _cv.notify_one();
+  return result;
+}
+
+bool Batcher::compatible(const Request& a, const Request& b){
+  return a.type == b.type && a.shape.size() == b.shape.size()
+    && std::equal(a.shape.begin() + 1, a.shape.end(), b.shape.begin() + 1);
+}
+
+void Batcher::loop(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true){
+    _cv.wait(lock, [this]{ return _stop || !_queue.empty(); });
+    if (_queue.empty())
+      return;
+    // Hold the batch open until it is full or the oldest request expires.
+    auto deadline = _queue.front().enqueued + _maxWait;
+    _cv.wait_until(lock, deadline, [this]{ return _stop || _queuedRows >= _maxBatchSize; });
+    std::vector<Request> batch;
+    size_t rows = 0;
+    do {
+      rows += _queue.front().shape[0];
+      batch.push_back(std::move(_queue.front()));
+      _queue.pop_front();
+    } while (!_queue.empty() && rows + _queue.front().shape[0] <= _maxBatchSize && compatible(batch.front(), _queue.front()));
+    _queuedRows -= rows;
+    lock.unlock();
+    dispatch(batch);
+    lock.lock();
+  }
+}
+
+void Batcher::dispatch(std::vector<Request>& batch){
+  try {
+    if (batch.size() == 1){
+      std::shared_ptr<std::vector<Ort::Value>> outputs = _model->run(batch[0].input);
+      if (outputs == nullptr)
+        throw std::runtime_error("Batched run failed");
+      batch[0].promise.set_value(outputs);
+      return;
+    }
+    std::vector<const Ort::Value*> inputs;
+    std::vector<int64_t> rows;
+    for (Request& request : batch){
+      inputs.push_back(&request.input);
+      rows.push_back(request.shape[0]);
+    }
+    Ort::Value merged = concatTensors(inputs, _allocator);
+    std::shared_ptr<std::vector<Ort::Value>> outputs = _model->run(merged);
+    if (outputs == nullptr)
+      throw std::runtime_error("Batched run failed");
+    std::vector<std::vector<Ort::Value>> results(batch.size());
+    for (Ort::Value& output : *outputs){
+      std::vector<Ort::Value> parts = _batchIndex ? splitByBatchIndex(output, rows, _allocator) : splitTensor(output, rows, _allocator);
+      for (size_t i = 0; i < parts.size(); ++i)
+        results[i].push_back(std::move(parts[i]));
+    }
+    for (size_t i = 0; i < batch.size(); ++i)
+      batch[i].promise.set_value(std::make_shared<std::vector<Ort::Value>>(std::move(results[i])));
+  }
+  catch (...) {
+    for (Request& request : batch)
+      request.promise.set_exception(std::current_exception());
+  }
+}
@@ -0,0 +1,33 @@
+#include "binding.h"
+#include "core.h"
+
+using namespace cinrt::model;
+
+Binding::Binding(Ort::Session& session, std::shared_ptr<Model> owner)
+  : _owner(std::move(owner)), _session(session), _binding(session),
+    _memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {}
+
+void Binding::bindInput(const std::string& name, const Ort::Value& value){
+  _binding.BindInput(name.c_str(), value);
+}
+
+void Binding::bindOutput(const std::string& name, const Ort::Value& value){
+  _binding.BindOutput(name.c_str(), value);
+}
+
+void Binding::bindOutput(const std::string& name){
+  _binding.BindOutput(name.c_str(), _memoryInfo);
+}
+
+void Binding::clear(){
+  _binding.ClearBoundInputs();
+  _binding.ClearBoundOutputs();
+}
+
+void Binding::run(const Ort::RunOptions& runOptions){
+  _session.Run(runOptions, _binding);
+}
+
+std::vector<Ort::Value> Binding::outputs() const {
+  return _binding.GetOutputValues();
+}
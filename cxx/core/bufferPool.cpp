@@ -0,0 +1,210 @@
+#include "bufferPool.h"
+#include "tensor.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace cinrt::model
+{
+  namespace
+  {
+    // Classes up to 1 MiB are cached per thread, a few buffers each.
+    constexpr int CACHED_CLASSES = 20 - BufferPool::MIN_SHIFT + 1;
+    constexpr size_t CACHE_DEPTH = 4;
+
+    void* alignedAlloc(size_t bytes){
+#ifndef _WIN32
+      void* data = std::aligned_alloc(BufferPool::ALIGNMENT, bytes);
+#else
+      void* data = _aligned_malloc(bytes, BufferPool::ALIGNMENT);
+#endif
+      if (data == nullptr)
+        throw std::bad_alloc();
+      return data;
+    }
+
+    void alignedFree(void* data){
+#ifndef _WIN32
+      std::free(data);
+#else
+      _aligned_free(data);
+#endif
+    }
+
+    // Buffers of one class are interchangeable between pools, so a thread
+    // keeps a single cache for all of them.
+    struct ThreadCache;
+    // Cleared at thread exit, buffers released later skip the cache.
+    thread_local ThreadCache* currentCache = nullptr;
+
+    struct ThreadCache
+    {
+      void* blocks[CACHED_CLASSES][CACHE_DEPTH];
+      size_t count[CACHED_CLASSES] = {};
+
+      ThreadCache(){ currentCache = this; }
+      ~ThreadCache(){
+        currentCache = nullptr;
+        for (int c = 0; c < CACHED_CLASSES; ++c)
+          for (size_t i = 0; i < count[c]; ++i)
+            alignedFree(blocks[c][i]);
+      }
+    };
+
+    ThreadCache* threadCache(){
+      thread_local ThreadCache cache;
+      return currentCache;
+    }
+
+    int sizeClass(size_t bytes){
+      int shift = BufferPool::MIN_SHIFT;
+      while (shift <= BufferPool::MAX_SHIFT && (size_t(1) << shift) < bytes)
+        ++shift;
+      return shift <= BufferPool::MAX_SHIFT ? shift - BufferPool::MIN_SHIFT : -1;
+    }
+  }
+
+  BufferPool::State::~State(){
+    for (std::vector<void*>& blocks : free)
+      for (void* block : blocks)
+        alignedFree(block);
+  }
+
+  BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : _state(std::move(other._state)), _data(other._data), _size(other._size), _class(other._class) {
+    other._data = nullptr;
+  }
+
+  BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other){
+      release();
+      _state = std::move(other._state);
+      _data = other._data;
+      _size = other._size;
+      _class = other._class;
+      other._data = nullptr;
+    }
+    return *this;
+  }
+
+  void BufferPool::Buffer::release(){
+    if (_data == nullptr)
+      return;
+    void* data = _data;
+    _data = nullptr;
+    std::shared_ptr<State> state = std::move(_state);
+    if (_class < 0){
+      alignedFree(data);
+      return;
+    }
+    if (_class < CACHED_CLASSES){
+      ThreadCache* cache = threadCache();
+      if (cache != nullptr && cache->count[_class] < CACHE_DEPTH){
+        cache->blocks[_class][cache->count[_class]++] = data;
+        return;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->pooledBytes + _size <= state->maxPooledBytes){
+        state->free[_class].push_back(data);
+        state->pooledBytes += _size;
+        return;
+      }
+    }
+    alignedFree(data);
+  }
+
+  BufferPool::BufferPool(size_t maxPooledBytes)
+    : _state(std::make_shared<State>()), _memoryInfo(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault)) {
+    _state->maxPooledBytes = maxPooledBytes;
+  }
+
+  BufferPool::Buffer BufferPool::acquire(size_t bytes){
+    Buffer buffer;
+    buffer._state = _state;
+    buffer._class = sizeClass(bytes);
+    if (buffer._class < 0){
+      // Too large to keep around, rounded up for aligned_alloc.
+      buffer._size = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+      buffer._data = alignedAlloc(buffer._size);
+      _state->misses.add();
+      return buffer;
+    }
+    buffer._size = size_t(1) << (buffer._class + MIN_SHIFT);
+    if (buffer._class < CACHED_CLASSES){
+      ThreadCache* cache = threadCache();
+      if (cache != nullptr && cache->count[buffer._class] > 0){
+        buffer._data = cache->blocks[buffer._class][--cache->count[buffer._class]];
+        _state->hits.add();
+        return buffer;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(_state->mutex);
+      std::vector<void*>& blocks = _state->free[buffer._class];
+      if (!blocks.empty()){
+        buffer._data = blocks.back();
+        blocks.pop_back();
+        _state->pooledBytes -= buffer._size;
+      }
+    }
+    if (buffer._data != nullptr){
+      _state->hits.add();
+      return buffer;
+    }
+    buffer._data = alignedAlloc(buffer._size);
+    _state->misses.add();
+    return buffer;
+  }
+
+  BufferPool::Tensor BufferPool::tensor(ONNXTensorElementDataType type, const std::vector<int64_t>& shape){
+    size_t bytes = elementSize(type);
+    if (bytes == 0)
+      throw std::runtime_error("Unsupported tensor element type");
+    for (int64_t dim : shape){
+      if (dim < 0)
+        throw std::runtime_error("Tensor shape has dynamic dimensions");
+      bytes *= static_cast<size_t>(dim);
+    }
+    Tensor tensor;
+    tensor.buffer = acquire(bytes);
+    tensor.value = Ort::Value::CreateTensor(_memoryInfo, tensor.buffer.data(), bytes, shape.data(), shape.size(), type);
+    return tensor;
+  }
+
+  BufferPool::Tensor BufferPool::clone(const Ort::Value& value){
+    auto info = value.GetTensorTypeAndShapeInfo();
+    Tensor copy = tensor(info.GetElementType(), info.GetShape());
+    std::memcpy(copy.value.GetTensorMutableRawData(), value.GetTensorRawData(), tensorBytes(value));
+    return copy;
+  }
+
+  void BufferPool::trim(){
+    std::vector<void*> blocks;
+    {
+      std::lock_guard<std::mutex> lock(_state->mutex);
+      for (std::vector<void*>& list : _state->free){
+        blocks.insert(blocks.end(), list.begin(), list.end());
+        list.clear();
+        list.shrink_to_fit();
+      }
+      _state->pooledBytes = 0;
+    }
+    for (void* block : blocks)
+      alignedFree(block);
+  }
+
+  BufferPoolStats BufferPool::getStats() const {
+    BufferPoolStats stats;
+    stats.hits = _state->hits.value();
+    stats.misses = _state->misses.value();
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    stats.pooledBytes = _state->pooledBytes;
+    return stats;
+  }
+};
@@ -0,0 +1,93 @@
+#include "executor.h"
+#include <algorithm>
+#include <map>
+
+using namespace cinrt::model;
+
+Executor::Executor(size_t workers, size_t capacity, QueuePolicy policy)
+  : _capacity(capacity > 0 ? capacity : 1), _policy(policy) {
+  if (workers == 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  _workers.reserve(workers);
+  for (size_t i = 0; i < workers; ++i)
+    _workers.emplace_back(&Executor::loop, this);
+}
+
+Executor::~Executor(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _notEmpty.notify_all();
+  _notFull.notify_all();
+  for (std::thread& worker : _workers)
+    if (worker.joinable())
+      worker.join();
+}
+
+bool Executor::post(std::function<void()> task){
+  std::function<void()> dropped;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_stop)
+      return false;
+    if (_queue.size() >= _capacity){
+      switch (_policy){
+      case QueuePolicy::Reject:
+        return false;
+      case QueuePolicy::Block:
+        _notFull.wait(lock, [this]{ return _stop || _queue.size() < _capacity; });
+        if (_stop)
+          return false;
+        break;
+      case QueuePolicy::DropOldest:
+        // Destroy outside the lock, it may release a promise.
+        dropped = std::move(_queue.front());
+        _queue.pop_front();
+        break;
+      }
+    }
+    _queue.push_back(std::move(task));
+  }
+  _notEmpty.notify_one();
+  return true;
+}
+
+size_t Executor::pending(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _queue.size();
+}
+
+void Executor::loop(){
+  while (true){
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _notEmpty.wait(lock, [this]{ return _stop || !_queue.empty(); });
+      if (_queue.empty())
+        return;
+      task = std::move(_queue.front());
+      _queue.pop_front();
+    }
+    _notFull.notify_one();
+    task();
+  }
+}
+
+std::shared_ptr<Executor> Executor::shared(){
+  static std::shared_ptr<Executor> executor = std::make_shared<Executor>();
+  return executor;
+}
+
+std::shared_ptr<Executor> Executor::forSessions(int intraThreads){
+  static std::mutex mutex;
+  static std::map<size_t, std::shared_ptr<Executor>> executors;
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  size_t perRun = intraThreads > 0 ? std::min(static_cast<size_t>(intraThreads), cores) : cores;
+  size_t workers = std::max<size_t>(1, cores / perRun);
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<Executor>& executor = executors[workers];
+  if (executor == nullptr)
+    executor = std::make_shared<Executor>(workers);
+  return executor;
+}
@@ -0,0 +1,195 @@
+#include "frameStream.h"
+#include "core.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace cinrt::model;
+
+namespace
+{
+  using SadRow = uint32_t (*)(const uint8_t* a, const uint8_t* b, int size);
+
+  uint32_t sadScalar(const uint8_t* a, const uint8_t* b, int size){
+    uint32_t sum = 0;
+    for (int i = 0; i < size; ++i)
+      sum += static_cast<uint32_t>(std::abs(a[i] - b[i]));
+    return sum;
+  }
+
+#ifdef CRT_X86_SIMD
+  __attribute__((target("sse4.1"))) uint32_t sadSSE41(const uint8_t* a, const uint8_t* b, int size){
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= size; i += 16){
+      const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+      const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    uint32_t sum = static_cast<uint32_t>(_mm_cvtsi128_si32(acc) + _mm_extract_epi32(acc, 2));
+    return sum + sadScalar(a + i, b + i, size - i);
+  }
+
+  __attribute__((target("avx2"))) uint32_t sadAVX2(const uint8_t* a, const uint8_t* b, int size){
+    __m256i acc = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= size; i += 32){
+      const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+      const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+    const __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    uint32_t sum = static_cast<uint32_t>(_mm_cvtsi128_si32(half) + _mm_extract_epi32(half, 2));
+    return sum + sadSSE41(a + i, b + i, size - i);
+  }
+#endif
+
+  // AVX-512 gains nothing on thumbnail rows, it uses the AVX2 kernel.
+  SadRow selectSad(SimdLevel requested){
+    SimdLevel level = std::min(requested, detectSimd());
+#ifdef CRT_X86_SIMD
+    if (level >= SimdLevel::AVX2)
+      return sadAVX2;
+    if (level == SimdLevel::SSE41)
+      return sadSSE41;
+#endif
+    (void)level;
+    return sadScalar;
+  }
+}
+
+FrameStream::FrameStream(Model* model, const FrameDeltaOptions& options) : _model(model), _options(options) {
+  const std::vector<TensorInfo>& inputs = model->getInputs();
+  if (inputs.size() != 1 || inputs[0].shape.size() != 4 || inputs[0].type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT
+      || inputs[0].shape[0] > 1 || (inputs[0].shape[1] > 0 && inputs[0].shape[1] != 3))
+    throw std::runtime_error("Frame streams need a single float {1, 3, H, W} input");
+  const std::vector<int64_t>& shape = inputs[0].shape;
+  if (_options.width <= 0)
+    _options.width = static_cast<int>(shape[3]);
+  if (_options.height <= 0)
+    _options.height = static_cast<int>(shape[2]);
+  if (_options.width <= 0 || _options.height <= 0)
+    throw std::runtime_error("Frame streams need an input size for a dynamic input");
+  if (_options.cell < 1)
+    _options.cell = 1;
+  _options.maxShift = std::max(_options.maxShift, 0);
+  _sad = selectSad(_options.preprocess.simd);
+  Ort::AllocatorWithDefaultOptions allocator;
+  const std::vector<int64_t> inputShape = {1, 3, _options.height, _options.width};
+  _inputNames.push_back(inputs[0].name);
+  _inputs.push_back(Ort::Value::CreateTensor<float>(allocator, inputShape.data(), inputShape.size()));
+}
+
+void FrameStream::reset(){
+  _last = FrameResult();
+}
+
+void FrameStream::downsample(const ImageView& frame){
+  const size_t stride = frame.stride > 0 ? frame.stride : static_cast<size_t>(frame.width) * 3;
+  const int cell = _options.cell;
+  const int rowBytes = 3 * cell;
+  const uint32_t count = static_cast<uint32_t>(rowBytes * cell);
+  _thumbWidth = frame.width / cell;
+  _thumbHeight = frame.height / cell;
+  _thumbnail.resize(static_cast<size_t>(_thumbWidth) * _thumbHeight);
+  std::vector<uint32_t> sums(_thumbWidth);
+  for (int ty = 0; ty < _thumbHeight; ++ty){
+    std::fill(sums.begin(), sums.end(), 0);
+    for (int r = 0; r < cell; ++r){
+      const uint8_t* row = frame.data + (static_cast<size_t>(ty) * cell + r) * stride;
+      for (int tx = 0; tx < _thumbWidth; ++tx){
+        const uint8_t* pixels = row + static_cast<size_t>(tx) * rowBytes;
+        uint32_t sum = 0;
+        for (int i = 0; i < rowBytes; ++i)
+          sum += pixels[i];
+        sums[tx] += sum;
+      }
+    }
+    uint8_t* out = _thumbnail.data() + static_cast<size_t>(ty) * _thumbWidth;
+    for (int tx = 0; tx < _thumbWidth; ++tx)
+      out[tx] = static_cast<uint8_t>((sums[tx] + count / 2) / count);
+  }
+}
+
+float FrameStream::difference(int dx, int dy) const {
+  // Thumbnail cell (x, y) is compared with reference cell (x - dx, y - dy).
+  const int x0 = std::max(0, dx);
+  const int x1 = std::min(_thumbWidth, _thumbWidth + dx);
+  const int y0 = std::max(0, dy);
+  const int y1 = std::min(_thumbHeight, _thumbHeight + dy);
+  if (x1 <= x0 || y1 <= y0)
+    return 255.f;
+  uint64_t sad = 0;
+  for (int y = y0; y < y1; ++y)
+    sad += _sad(_thumbnail.data() + static_cast<size_t>(y) * _thumbWidth + x0,
+      _reference.data() + static_cast<size_t>(y - dy) * _thumbWidth + (x0 - dx), x1 - x0);
+  return static_cast<float>(sad) / (static_cast<float>(x1 - x0) * (y1 - y0));
+}
+
+FrameResult FrameStream::infer(const ImageView& frame, const Ort::RunOptions& runOptions){
+  float* dst = _inputs[0].GetTensorMutableData<float>();
+  Rescale scale;
+  if (_options.letterbox){
+    Letterbox box = Letterbox::fit(frame.width, frame.height, _options.width, _options.height);
+    letterboxToTensor(frame, dst, _options.width, _options.height, box, _options.preprocess);
+    scale = Rescale::letterbox(box, frame.width, frame.height);
+  } else {
+    imageToTensor(frame, dst, _options.width, _options.height, _options.preprocess);
+    scale = Rescale::stretch(_options.width, _options.height, frame.width, frame.height);
+  }
+  std::shared_ptr<std::vector<Ort::Value>> outputs = _model->run(_inputNames, _inputs, {}, runOptions);
+  if (outputs == nullptr)
+    throw std::runtime_error("Inference failed");
+  ++_inferences;
+  _reference.swap(_thumbnail);
+  _frameWidth = frame.width;
+  _frameHeight = frame.height;
+  _sinceRefresh = 0;
+  _last = FrameResult();
+  _last.outputs = outputs;
+  _last.scale = scale;
+  _last.inferred = true;
+  return _last;
+}
+
+FrameResult FrameStream::next(const ImageView& frame, const Ort::RunOptions& runOptions){
+  if (frame.data == nullptr || frame.width < _options.cell || frame.height < _options.cell)
+    throw std::runtime_error("Frame is empty or smaller than a cell");
+  ++_frames;
+  downsample(frame);
+  const bool refresh = _last.outputs == nullptr || frame.width != _frameWidth || frame.height != _frameHeight
+    || (_options.refreshEvery > 0 && _sinceRefresh + 1 >= _options.refreshEvery);
+  if (refresh)
+    return infer(frame, runOptions);
+  FrameResult result = _last;
+  result.inferred = false;
+  result.difference = difference(0, 0);
+  if (result.difference > _options.threshold && _options.motionShift){
+    // Global translation only, the best match over the search window.
+    int bestX = 0;
+    int bestY = 0;
+    for (int dy = -_options.maxShift; dy <= _options.maxShift; ++dy)
+      for (int dx = -_options.maxShift; dx <= _options.maxShift; ++dx){
+        if (dx == 0 && dy == 0)
+          continue;
+        float shifted = difference(dx, dy);
+        if (shifted < result.difference){
+          result.difference = shifted;
+          bestX = dx;
+          bestY = dy;
+        }
+      }
+    result.shiftX = bestX * _options.cell;
+    result.shiftY = bestY * _options.cell;
+  }
+  if (result.difference > _options.threshold)
+    return infer(frame, runOptions);
+  ++_sinceRefresh;
+  _model->_metrics->skippedFrames.add();
+  return result;
+}
@@ -0,0 +1,104 @@
+#include "hash.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace cinrt::model
+{
+  namespace
+  {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    inline uint64_t read64(const unsigned char* p) {
+      uint64_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint32_t read32(const unsigned char* p) {
+      uint32_t v;
+      std::memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+      acc += input * PRIME2;
+      return rotl(acc, 31) * PRIME1;
+    }
+
+    inline uint64_t merge(uint64_t acc, uint64_t value) {
+      acc ^= round(0, value);
+      return acc * PRIME1 + PRIME4;
+    }
+  }
+
+  uint64_t hash64(const void* data, size_t size, uint64_t seed){
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+    if (size >= 32){
+      // Four independent lanes keep the multiplies pipelined.
+      uint64_t v1 = seed + PRIME1 + PRIME2;
+      uint64_t v2 = seed + PRIME2;
+      uint64_t v3 = seed;
+      uint64_t v4 = seed - PRIME1;
+      const unsigned char* limit = end - 32;
+      do {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+      } while (p <= limit);
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = merge(h, v1);
+      h = merge(h, v2);
+      h = merge(h, v3);
+      h = merge(h, v4);
+    } else {
+      h = seed + PRIME5;
+    }
+    h += static_cast<uint64_t>(size);
+    for (; p + 8 <= end; p += 8){
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end){
+      h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+      h = rotl(h, 23) * PRIME2 + PRIME3;
+      p += 4;
+    }
+    for (; p < end; ++p){
+      h ^= (*p) * PRIME5;
+      h = rotl(h, 11) * PRIME1;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  uint64_t hashFile(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+      throw std::runtime_error("Cannot open " + path);
+    std::vector<char> chunk(1 << 20);
+    uint64_t h = 0;
+    while (file){
+      file.read(chunk.data(), chunk.size());
+      std::streamsize count = file.gcount();
+      if (count > 0)
+        h = hash64(chunk.data(), static_cast<size_t>(count), h);
+    }
+    return h;
+  }
+};
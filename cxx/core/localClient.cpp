@@ -0,0 +1,171 @@
+#include "localClient.h"
+#include "tensor.h"
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace cinrt::model;
+
+namespace
+{
+  struct RingRelease
+  {
+    SharedRing& ring;
+    uint64_t end;
+    ~RingRelease(){ ring.release(end); }
+  };
+}
+
+LocalClient::LocalClient(const std::string& path, size_t ringBytes){
+#ifndef _WIN32
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Socket path too long: " + path);
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (_socket < 0)
+    throw std::runtime_error("Cannot create client socket");
+  try {
+    if (::connect(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+      throw std::runtime_error("Cannot connect to " + path);
+    _region = std::make_unique<SharedRegion>(ringBytes);
+    WireMessage hello;
+    hello.put(_region->ringBytes());
+    WireMessage reply;
+    if (!sendDescriptor(_socket, _region->fd()) || !hello.send(_socket) || !reply.receive(_socket))
+      throw std::runtime_error("Local server is gone");
+    if (reply.get<LocalStatus>() != LocalStatus::Ok)
+      throw std::runtime_error(reply.getString());
+  }
+  catch (...) {
+    ::close(_socket);
+    throw;
+  }
+  _requests = _region->requests();
+  _responses = _region->responses();
+#else
+  (void)path;
+  (void)ringBytes;
+  throw std::runtime_error("Local client is not supported on Windows");
+#endif
+}
+
+LocalClient::~LocalClient(){
+#ifndef _WIN32
+  if (_socket >= 0)
+    ::close(_socket);
+#endif
+}
+
+void LocalClient::putInputs(
+  WireMessage& request,
+  const std::vector<std::string>& inputNames,
+  const std::vector<const Ort::Value*>& inputs){
+  // Nothing is outstanding, the server released the ring with the last
+  // reply. The head after the inputs leads the request, see run.
+  const uint64_t start = _requests.head();
+  request.put(static_cast<uint32_t>(inputs.size()));
+  for (size_t i = 0; i < inputs.size(); ++i){
+    const Ort::Value& input = *inputs[i];
+    if (!input.IsTensor())
+      throw std::runtime_error("Only tensor inputs are served");
+    auto info = input.GetTensorTypeAndShapeInfo();
+    const ONNXTensorElementDataType type = info.GetElementType();
+    if (elementSize(type) == 0)
+      throw std::runtime_error("Only fixed-size inputs are served");
+    const std::vector<int64_t> shape = info.GetShape();
+    const uint64_t bytes = tensorBytes(input);
+    uint64_t offset = 0;
+    if (!_requests.allocate(bytes, offset)){
+      _requests.rewind(start);
+      throw std::runtime_error("Inputs exceed the request ring");
+    }
+    std::memcpy(_requests.at(offset, bytes), input.GetTensorRawData(), bytes);
+    request.putString(inputNames[i]);
+    request.put(static_cast<int32_t>(type));
+    request.put(static_cast<uint32_t>(shape.size()));
+    for (int64_t dim : shape)
+      request.put(dim);
+    request.put(offset);
+    request.put(bytes);
+  }
+}
+
+std::shared_ptr<std::vector<Ort::Value>> LocalClient::call(WireMessage& request){
+  WireMessage reply;
+  if (!request.send(_socket) || !reply.receive(_socket))
+    throw std::runtime_error("Local server is gone");
+  const LocalStatus status = reply.get<LocalStatus>();
+  if (status == LocalStatus::Error)
+    throw std::runtime_error(reply.getString());
+  if (status == LocalStatus::Failed)
+    return nullptr;
+  // Outputs are copied out, the ring is released even on a bad reply.
+  RingRelease release{_responses, reply.get<uint64_t>()};
+  const uint32_t count = reply.get<uint32_t>();
+  auto outputs = std::make_shared<std::vector<Ort::Value>>();
+  outputs->reserve(count);
+  for (uint32_t i = 0; i < count; ++i){
+    const auto type = static_cast<ONNXTensorElementDataType>(reply.get<int32_t>());
+    std::vector<int64_t> shape(reply.get<uint32_t>());
+    for (int64_t& dim : shape)
+      dim = reply.get<int64_t>();
+    const uint64_t offset = reply.get<uint64_t>();
+    const uint64_t bytes = reply.get<uint64_t>();
+    const uint8_t* data = _responses.at(offset, bytes);
+    if (data == nullptr)
+      throw std::runtime_error("Invalid output tensor");
+    outputs->push_back(Ort::Value::CreateTensor(_allocator, shape.data(), shape.size(), type));
+    if (tensorBytes(outputs->back()) != bytes)
+      throw std::runtime_error("Invalid output tensor");
+    std::memcpy(outputs->back().GetTensorMutableRawData(), data, bytes);
+  }
+  return outputs;
+}
+
+std::shared_ptr<std::vector<Ort::Value>> LocalClient::run(
+  const std::string& model,
+  const Ort::Value& inputs,
+  std::shared_ptr<const char*> outputHead){
+  std::lock_guard<std::mutex> lock(_mutex);
+  WireMessage body;
+  putInputs(body, {""}, {&inputs});
+  WireMessage request;
+  request.put(_requests.head());
+  request.put(uint8_t(1));
+  request.putString(model);
+  request.append(body);
+  request.put(uint32_t(outputHead != nullptr ? 1 : 0));
+  if (outputHead != nullptr)
+    request.putString(*outputHead);
+  return call(request);
+}
+
+std::shared_ptr<std::vector<Ort::Value>> LocalClient::run(
+  const std::string& model,
+  const std::vector<std::string>& inputNames,
+  const std::vector<Ort::Value>& inputs,
+  const std::vector<std::string>& outputNames){
+  if (inputNames.size() != inputs.size())
+    throw std::runtime_error("Input names and values do not match");
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<const Ort::Value*> values;
+  for (const Ort::Value& input : inputs)
+    values.push_back(&input);
+  WireMessage body;
+  putInputs(body, inputNames, values);
+  WireMessage request;
+  request.put(_requests.head());
+  request.put(uint8_t(0));
+  request.putString(model);
+  request.append(body);
+  request.put(static_cast<uint32_t>(outputNames.size()));
+  for (const std::string& name : outputNames)
+    request.putString(name);
+  return call(request);
+}
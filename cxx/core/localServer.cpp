@@ -0,0 +1,256 @@
+#include "localServer.h"
+#include "core.h"
+#include "tensor.h"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace cinrt::model;
+
+namespace
+{
+  // Releases the request ring once the run no longer reads the inputs.
+  struct RingRelease
+  {
+    SharedRing& ring;
+    uint64_t end;
+    ~RingRelease(){ ring.release(end); }
+  };
+
+  std::vector<int64_t> getShape(WireMessage& message){
+    uint32_t rank = message.get<uint32_t>();
+    if (rank > 64)
+      throw std::runtime_error("Invalid tensor rank");
+    std::vector<int64_t> shape(rank);
+    for (int64_t& dim : shape){
+      dim = message.get<int64_t>();
+      if (dim < 0)
+        throw std::runtime_error("Invalid tensor shape");
+    }
+    return shape;
+  }
+}
+
+LocalServer::LocalServer(modelManager& manager, const std::string& path)
+  : _manager(manager), _path(path), _memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {
+#ifndef _WIN32
+  sockaddr_un address{};
+  if (path.size() >= sizeof(address.sun_path))
+    throw std::runtime_error("Socket path too long: " + path);
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (_socket < 0)
+    throw std::runtime_error("Cannot create server socket");
+  ::unlink(path.c_str());
+  // Only the owner may connect, before anyone can.
+  if (::bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::chmod(path.c_str(), 0600) != 0 || ::listen(_socket, 64) != 0){
+    ::close(_socket);
+    throw std::runtime_error("Cannot listen on " + path);
+  }
+  _thread = std::thread(&LocalServer::loop, this);
+#else
+  throw std::runtime_error("Local server is not supported on Windows");
+#endif
+}
+
+LocalServer::~LocalServer(){
+  _stop = true;
+  if (_thread.joinable())
+    _thread.join();
+#ifndef _WIN32
+  // Wakes the connections blocked on their next request.
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (Connection& connection : _connections)
+    ::shutdown(connection.socket, SHUT_RDWR);
+  for (Connection& connection : _connections){
+    connection.thread.join();
+    ::close(connection.socket);
+  }
+  if (_socket >= 0){
+    ::close(_socket);
+    ::unlink(_path.c_str());
+  }
+#endif
+}
+
+size_t LocalServer::connections(){
+  std::lock_guard<std::mutex> lock(_mutex);
+  size_t open = 0;
+  for (const Connection& connection : _connections)
+    open += connection.done ? 0 : 1;
+  return open;
+}
+
+void LocalServer::reap(){
+#ifndef _WIN32
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto it = _connections.begin(); it != _connections.end();){
+    if (!it->done){
+      ++it;
+      continue;
+    }
+    it->thread.join();
+    ::close(it->socket);
+    it = _connections.erase(it);
+  }
+#endif
+}
+
+void LocalServer::loop(){
+#ifndef _WIN32
+  while (!_stop){
+    pollfd listening{_socket, POLLIN, 0};
+    if (::poll(&listening, 1, 100) <= 0){
+      reap();
+      continue;
+    }
+    int client = ::accept(_socket, nullptr, nullptr);
+    if (client < 0)
+      continue;
+    reap();
+    std::lock_guard<std::mutex> lock(_mutex);
+    Connection& connection = _connections.emplace_back();
+    connection.socket = client;
+    connection.thread = std::thread(&LocalServer::serve, this, std::ref(connection));
+  }
+#endif
+}
+
+void LocalServer::serve(Connection& connection){
+  // The socket is closed by whoever joins the thread.
+  int fd = receiveDescriptor(connection.socket);
+  if (fd < 0){
+    connection.done = true;
+    return;
+  }
+  // The client follows its descriptor with the ring size it created.
+  WireMessage hello;
+  if (!hello.receive(connection.socket)){
+    ::close(fd);
+    connection.done = true;
+    return;
+  }
+  std::unique_ptr<SharedRegion> region;
+  WireMessage reply;
+  try {
+    uint64_t ringBytes = hello.get<uint64_t>();
+    // attach owns the descriptor from here on, even when it throws.
+    int owned = std::exchange(fd, -1);
+    region = std::make_unique<SharedRegion>(SharedRegion::attach(owned, ringBytes));
+    reply.put(LocalStatus::Ok);
+  }
+  catch (std::exception& exception) {
+    if (fd >= 0)
+      ::close(fd);
+    reply.put(LocalStatus::Error);
+    reply.putString(exception.what());
+  }
+  if (!reply.send(connection.socket) || region == nullptr){
+    connection.done = true;
+    return;
+  }
+  SharedRing requests = region->requests();
+  SharedRing responses = region->responses();
+  WireMessage request;
+  while (!_stop && request.receive(connection.socket)){
+    reply.clear();
+    const uint64_t start = responses.head();
+    try {
+      handle(request, reply, requests, responses);
+    }
+    catch (std::exception& exception) {
+      responses.rewind(start);
+      reply.clear();
+      reply.put(LocalStatus::Error);
+      reply.putString(exception.what());
+    }
+    if (!reply.send(connection.socket))
+      break;
+  }
+  connection.done = true;
+}
+
+void LocalServer::handle(WireMessage& request, WireMessage& reply, SharedRing& requests, SharedRing& responses){
+  RingRelease release{requests, request.get<uint64_t>()};
+  const bool single = request.get<uint8_t>() != 0;
+  const std::string name = request.getString();
+  const uint32_t inputCount = request.get<uint32_t>();
+  std::vector<std::string> inputNames;
+  std::vector<Ort::Value> inputs;
+  for (uint32_t i = 0; i < inputCount; ++i){
+    inputNames.push_back(request.getString());
+    const auto type = static_cast<ONNXTensorElementDataType>(request.get<int32_t>());
+    std::vector<int64_t> shape = getShape(request);
+    const uint64_t offset = request.get<uint64_t>();
+    const uint64_t bytes = request.get<uint64_t>();
+    size_t count = 1;
+    for (int64_t dim : shape)
+      count *= static_cast<size_t>(dim);
+    uint8_t* data = requests.at(offset, bytes);
+    if (elementSize(type) == 0 || data == nullptr || bytes != count * elementSize(type))
+      throw std::runtime_error("Invalid input tensor " + inputNames.back());
+    // The session reads the input in place, in the client's ring.
+    inputs.push_back(Ort::Value::CreateTensor(_memoryInfo, data, bytes, shape.data(), shape.size(), type));
+  }
+  const uint32_t outputCount = request.get<uint32_t>();
+  std::vector<std::string> outputNames;
+  for (uint32_t i = 0; i < outputCount; ++i)
+    outputNames.push_back(request.getString());
+
+  std::shared_ptr<Model> model = _manager.acquireModel(name);
+  if (model == nullptr)
+    throw std::runtime_error("Model not found: " + name);
+  std::shared_ptr<std::vector<Ort::Value>> outputs;
+  if (single){
+    if (inputs.size() != 1 || outputNames.size() > 1)
+      throw std::runtime_error("Invalid single-input request");
+    std::shared_ptr<const char*> outputHead;
+    if (!outputNames.empty() && !outputNames[0].empty())
+      outputHead = std::make_shared<const char*>(outputNames[0].c_str());
+    if (outputHead == nullptr && model->batching())
+      outputs = model->runBatched(inputs[0]).get();
+    else
+      outputs = model->run(inputs[0], outputHead);
+  } else {
+    outputs = model->run(inputNames, inputs, outputNames);
+  }
+  if (outputs == nullptr){
+    reply.put(LocalStatus::Failed);
+    return;
+  }
+
+  WireMessage body;
+  body.put(static_cast<uint32_t>(outputs->size()));
+  for (const Ort::Value& output : *outputs){
+    if (!output.IsTensor())
+      throw std::runtime_error("Only tensor outputs are served");
+    auto info = output.GetTensorTypeAndShapeInfo();
+    const ONNXTensorElementDataType type = info.GetElementType();
+    if (elementSize(type) == 0)
+      throw std::runtime_error("Only fixed-size outputs are served");
+    const std::vector<int64_t> shape = info.GetShape();
+    const uint64_t bytes = tensorBytes(output);
+    uint64_t offset = 0;
+    if (!responses.allocate(bytes, offset))
+      throw std::runtime_error("Outputs exceed the client response ring");
+    std::memcpy(responses.at(offset, bytes), output.GetTensorRawData(), bytes);
+    body.put(static_cast<int32_t>(type));
+    body.put(static_cast<uint32_t>(shape.size()));
+    for (int64_t dim : shape)
+      body.put(dim);
+    body.put(offset);
+    body.put(bytes);
+  }
+  // The client releases the ring up to the head, read before the outputs.
+  reply.put(LocalStatus::Ok);
+  reply.put(responses.head());
+  reply.append(body);
+}
@@ -0,0 +1,49 @@
+#include "mappedFile.h"
+#include <fstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cinrt::model;
+
+MappedFile::MappedFile(const std::string& path){
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Cannot open " + path);
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size == 0){
+    ::close(fd);
+    throw std::runtime_error("Cannot map " + path);
+  }
+  _size = static_cast<size_t>(info.st_size);
+  _data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file.
+  ::close(fd);
+  if (_data == MAP_FAILED){
+    _data = nullptr;
+    throw std::runtime_error("Cannot map " + path);
+  }
+  ::madvise(_data, _size, MADV_WILLNEED);
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file)
+    throw std::runtime_error("Cannot open " + path);
+  _buffer.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(_buffer.data(), _buffer.size());
+  _data = _buffer.data();
+  _size = _buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile(){
+#ifndef _WIN32
+  if (_data != nullptr)
+    ::munmap(_data, _size);
+#endif
+}
@@ -0,0 +1,214 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace cinrt::model
+{
+  namespace
+  {
+    size_t threadStripe(){
+      static std::atomic<size_t> next{0};
+      thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed);
+      return stripe;
+    }
+
+    std::string escape(const std::string& value){
+      std::string out;
+      for (char c : value){
+        if (c == '\\' || c == '"')
+          out.push_back('\\');
+        if (c == '\n'){
+          out += "\\n";
+          continue;
+        }
+        out.push_back(c);
+      }
+      return out;
+    }
+
+    void counter(std::ostringstream& out, const std::string& name, const std::string& help, const std::vector<ModelStats>& stats, uint64_t ModelStats::*field){
+      out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+      for (const ModelStats& model : stats)
+        out << name << "{model=\"" << escape(model.model) << "\"} " << model.*field << "\n";
+    }
+
+    // Histograms are exported as summaries in seconds.
+    void summary(std::ostringstream& out, const std::string& name, const std::string& help, const std::vector<ModelStats>& stats, HistogramSnapshot ModelStats::*field){
+      out << "# HELP " << name << " " << help << "\n# TYPE " << name << " summary\n";
+      for (const ModelStats& model : stats){
+        const HistogramSnapshot& histogram = model.*field;
+        std::string label = "model=\"" + escape(model.model) + "\"";
+        for (double q : {0.5, 0.9, 0.99})
+          out << name << "{" << label << ",quantile=\"" << q << "\"} " << histogram.percentile(q) * 1e-9 << "\n";
+        out << name << "_sum{" << label << "} " << histogram.sum * 1e-9 << "\n";
+        out << name << "_count{" << label << "} " << histogram.count << "\n";
+      }
+    }
+  }
+
+  void Counter::add(uint64_t count){
+    _cells[threadStripe() % STRIPES].value.fetch_add(count, std::memory_order_relaxed);
+  }
+
+  uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Cell& cell : _cells)
+      total += cell.value.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  uint64_t HistogramSnapshot::percentile(double q) const {
+    if (count == 0)
+      return 0;
+    uint64_t rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i){
+      seen += counts[i];
+      if (seen >= rank)
+        return Histogram::upperBound(i);
+    }
+    return Histogram::upperBound(counts.size() - 1);
+  }
+
+  size_t Histogram::bucket(uint64_t value){
+    if (value < (1u << SUB_BITS))
+      return static_cast<size_t>(value);
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_BITS)
+      return BUCKETS - 1;
+    // Top SUB_BITS + 1 bits of the value, the leading one included.
+    size_t sub = static_cast<size_t>(value >> (exponent - SUB_BITS)) - (1u << SUB_BITS);
+    return (static_cast<size_t>(exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+  }
+
+  uint64_t Histogram::upperBound(size_t bucket){
+    if (bucket < (1u << SUB_BITS))
+      return bucket;
+    int exponent = static_cast<int>(bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = (bucket & ((1u << SUB_BITS) - 1)) + (1u << SUB_BITS);
+    return ((sub + 1) << (exponent - SUB_BITS)) - 1;
+  }
+
+  Histogram::Histogram() : _stripes(new Stripe[STRIPES]()) {}
+
+  void Histogram::record(uint64_t value){
+    Stripe& stripe = _stripes[threadStripe() % STRIPES];
+    stripe.counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    stripe.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  HistogramSnapshot Histogram::snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.counts.assign(BUCKETS, 0);
+    for (size_t s = 0; s < STRIPES; ++s){
+      const Stripe& stripe = _stripes[s];
+      for (size_t i = 0; i < BUCKETS; ++i)
+        snapshot.counts[i] += stripe.counts[i].load(std::memory_order_relaxed);
+      snapshot.sum += stripe.sum.load(std::memory_order_relaxed);
+    }
+    for (uint64_t count : snapshot.counts)
+      snapshot.count += count;
+    return snapshot;
+  }
+
+  std::string toPrometheus(const std::vector<ModelStats>& stats){
+    std::ostringstream out;
+    out << std::setprecision(9);
+    counter(out, "cinnamon_requests_total", "Model runs.", stats, &ModelStats::requests);
+    counter(out, "cinnamon_failures_total", "Model runs that failed.", stats, &ModelStats::failures);
+    counter(out, "cinnamon_loads_total", "Sessions loaded.", stats, &ModelStats::loads);
+    counter(out, "cinnamon_unloads_total", "Models removed, evictions included.", stats, &ModelStats::unloads);
+    counter(out, "cinnamon_evictions_total", "Models evicted by the service garbage collector.", stats, &ModelStats::evictions);
+    counter(out, "cinnamon_expired_total", "Scheduled requests that missed their deadline.", stats, &ModelStats::expired);
+    counter(out, "cinnamon_result_cache_hits_total", "Runs answered from the result cache.", stats, &ModelStats::cacheHits);
+    counter(out, "cinnamon_result_cache_misses_total", "Cacheable runs not found in the result cache.", stats, &ModelStats::cacheMisses);
+    counter(out, "cinnamon_skipped_frames_total", "Stream frames that reused the outputs of an earlier frame.", stats, &ModelStats::skippedFrames);
+    out << "# HELP cinnamon_replicas Loaded session replicas.\n# TYPE cinnamon_replicas gauge\n";
+    for (const ModelStats& model : stats)
+      out << "cinnamon_replicas{model=\"" << escape(model.model) << "\"} " << model.replicas << "\n";
+    out << "# HELP cinnamon_inflight Runs currently executing.\n# TYPE cinnamon_inflight gauge\n";
+    for (const ModelStats& model : stats)
+      out << "cinnamon_inflight{model=\"" << escape(model.model) << "\"} " << model.inflight << "\n";
+    summary(out, "cinnamon_run_seconds", "Model run latency.", stats, &ModelStats::latency);
+    summary(out, "cinnamon_queue_wait_seconds", "Time asynchronous runs waited for a worker.", stats, &ModelStats::queueWait);
+    summary(out, "cinnamon_load_seconds", "Session load time.", stats, &ModelStats::loadTime);
+    summary(out, "cinnamon_unload_seconds", "Time to release a removed model.", stats, &ModelStats::unloadTime);
+    return out.str();
+  }
+
+  MetricsEndpoint::MetricsEndpoint(const std::string& path, std::function<std::string()> render)
+    : _path(path), _render(render) {
+#ifndef _WIN32
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+      throw std::runtime_error("Socket path too long: " + path);
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_socket < 0)
+      throw std::runtime_error("Cannot create metrics socket");
+    ::unlink(path.c_str());
+    if (::bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(_socket, 8) != 0){
+      ::close(_socket);
+      throw std::runtime_error("Cannot listen on " + path);
+    }
+    _thread = std::thread(&MetricsEndpoint::loop, this);
+#else
+    throw std::runtime_error("Metrics socket is not supported on Windows");
+#endif
+  }
+
+  MetricsEndpoint::~MetricsEndpoint(){
+    _stop = true;
+    if (_thread.joinable())
+      _thread.join();
+#ifndef _WIN32
+    if (_socket >= 0){
+      ::close(_socket);
+      ::unlink(_path.c_str());
+    }
+#endif
+  }
+
+  void MetricsEndpoint::loop(){
+#ifndef _WIN32
+    while (!_stop){
+      pollfd listening{_socket, POLLIN, 0};
+      if (::poll(&listening, 1, 100) <= 0)
+        continue;
+      int client = ::accept(_socket, nullptr, nullptr);
+      if (client < 0)
+        continue;
+      // Plain clients (nc -U) send nothing, HTTP scrapers send a request line.
+      char request[4] = {};
+      pollfd reading{client, POLLIN, 0};
+      bool http = ::poll(&reading, 1, 50) > 0 && ::recv(client, request, sizeof(request), 0) == sizeof(request)
+        && std::memcmp(request, "GET ", 4) == 0;
+      std::string body = _render();
+      std::string response;
+      if (http){
+        response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+          + std::to_string(body.size()) + "\r\n\r\n";
+      }
+      response += body;
+      size_t sent = 0;
+      while (sent < response.size()){
+        ssize_t count = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (count <= 0)
+          break;
+        sent += static_cast<size_t>(count);
+      }
+      ::close(client);
+    }
+#endif
+  }
+};
@@ -1,26 +1,143 @@
 #include "core.h"
+#include "tensor.h"
+#include "resources.h"
 #include <onnxruntime_cxx_api.h>
 #include <iostream>
 #include <future>
 #include <thread>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <sstream>
 
 using namespace cinrt::model;
 
+namespace
+{
+  struct InflightGuard
+  {
+    std::atomic<int>& counter;
+    InflightGuard(std::atomic<int>& counter) : counter(counter) { counter.fetch_add(1, std::memory_order_relaxed); }
+    ~InflightGuard() { counter.fetch_sub(1, std::memory_order_relaxed); }
+  };
+
+  // Counts the run and its latency, as a failure unless succeeded is set.
+  struct RunRecorder
+  {
+    ModelMetrics& metrics;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool succeeded = false;
+    RunRecorder(ModelMetrics& metrics) : metrics(metrics) {}
+    ~RunRecorder() {
+      metrics.requests.add();
+      if (!succeeded)
+        metrics.failures.add();
+      metrics.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+  };
+
+  // Result cache lookup of a run, hits skip the session and are not counted
+  // as runs. cache is null when the run cannot be cached.
+  struct CacheLookup
+  {
+    std::shared_ptr<ResultCache> cache;
+    ResultKey key;
+    std::shared_ptr<std::vector<Ort::Value>> hit;
+    CacheLookup(
+      std::shared_ptr<ResultCache> resultCache,
+      ModelMetrics& metrics,
+      const char* const* inputHeads,
+      const Ort::Value* inputs,
+      size_t inputCount,
+      const char* const* outputHeads,
+      size_t outputCount) : cache(std::move(resultCache)) {
+      if (cache == nullptr || !ResultCache::key(inputHeads, inputs, inputCount, outputHeads, outputCount, key)){
+        cache = nullptr;
+        return;
+      }
+      hit = cache->find(key);
+      if (hit != nullptr)
+        metrics.cacheHits.add();
+      else
+        metrics.cacheMisses.add();
+    }
+    void store(const std::vector<Ort::Value>& outputs) {
+      if (cache != nullptr)
+        cache->insert(key, outputs);
+    }
+  };
+
+  // A runCallback request, owned by ORT from RunAsync until the callback.
+  struct CallbackRun
+  {
+    PendingCount* callbacks = nullptr;
+    std::shared_ptr<Ort::Session> profiled;
+    std::vector<std::string> inputNames;
+    std::vector<Ort::Value> inputs;
+    std::vector<std::string> outputNames;
+    // ORT reads the names and inputs, and fills outputs, from its thread.
+    std::vector<const char*> inputHeads;
+    std::vector<const char*> outputHeads;
+    std::vector<Ort::Value> outputs;
+    Ort::RunOptions runOptions{nullptr};
+    RunCallback done;
+    std::optional<CacheLookup> lookup;
+    std::optional<InflightGuard> guard;
+    std::optional<RunRecorder> recorder;
+  };
+
+  void finishCallbackRun(void* userData, OrtValue**, size_t, OrtStatusPtr status){
+    std::unique_ptr<CallbackRun> run(static_cast<CallbackRun*>(userData));
+    Ort::Status result(status);
+    std::shared_ptr<std::vector<Ort::Value>> outputs;
+    if (result.IsOK()){
+      // ORT filled the values it was handed.
+      outputs = std::make_shared<std::vector<Ort::Value>>(std::move(run->outputs));
+      run->lookup->store(*outputs);
+      run->recorder->succeeded = true;
+    } else {
+      std::cout << "Error: " << result.GetErrorMessage() << std::endl;
+    }
+    RunCallback done = std::move(run->done);
+    PendingCount* callbacks = run->callbacks;
+    // Counted and released before done, which may let the model go.
+    run.reset();
+    callbacks->done();
+    try {
+      done(std::move(outputs));
+    }
+    catch (std::exception& exception) {
+      std::cout << "Error: " << exception.what() << std::endl;
+    }
+  }
+
+  // Run result over pooled buffers, values are destroyed first.
+  struct PooledOutputs
+  {
+    std::vector<BufferPool::Buffer> buffers;
+    std::vector<Ort::Value> values;
+  };
+}
+
 Model::Model(
   std::string model,
   bool parallel,
   int graphOpLevel,
   int interThreads,
-  int intraThreads
+  int intraThreads,
+  const std::vector<ExecutionProvider>& providers
 ) {
   this->_env = std::make_shared<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "test");
+  this->_metrics = std::make_shared<ModelMetrics>();
   this->_sessionOptions = this->getSessionOptions(parallel, graphOpLevel, interThreads, intraThreads);
-  this->_session = std::make_unique<Ort::Session>(*this->_env, model.c_str(), *this->_sessionOptions);
+  this->_executor = Executor::forSessions(intraThreads);
+  this->_providers = appendProviders(*this->_sessionOptions, providers);
+  this->loadSession(model);
   this->_allocator = std::make_shared<Ort::Allocator>(*this->_session, Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault));
-  Ort::AllocatedStringPtr inputName = this->_session->GetInputNameAllocated(0, *this->_allocator);
-  Ort::AllocatedStringPtr outputName = this->_session->GetOutputNameAllocated(0, *this->_allocator);
-  this->inputNames = std::make_shared<const char*>(inputName.release());
-  this->outputNames = std::make_shared<const char*>(outputName.release());
+  this->loadIO();
 }
 
 Model::Model(
@@ -30,34 +147,198 @@ Model::Model(
   bool parallel,
   int graphOpLevel,
   int interThreads,
-  int intraThreads
+  int intraThreads,
+  std::shared_ptr<Ort::PrepackedWeightsContainer> prepacked,
+  bool globalThreads,
+  std::string optimizedPath,
+  bool mapped,
+  const std::vector<ExecutionProvider>& providers
 ) {
   _env = env;
   _allocator = allocator;
-  _sessionOptions = getSessionOptions(parallel, graphOpLevel, interThreads, intraThreads);
-  _session = std::make_unique<Ort::Session>(*_env, model.c_str(), *_sessionOptions);
+  _prepacked = prepacked;
+  _mapped = mapped;
+  _metrics = std::make_shared<ModelMetrics>();
+  _sessionOptions = getSessionOptions(parallel, graphOpLevel, interThreads, intraThreads, globalThreads);
+  // With global threads the manager sets the executor of its pool.
+  _executor = Executor::forSessions(globalThreads ? 0 : intraThreads);
+  _providers = appendProviders(*_sessionOptions, providers);
+  loadSession(model, optimizedPath);
   this->_allocator = std::make_shared<Ort::Allocator>(*this->_session, Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault));
-  Ort::AllocatedStringPtr inputName = this->_session->GetInputNameAllocated(0, *this->_allocator);
-  Ort::AllocatedStringPtr outputName = this->_session->GetOutputNameAllocated(0, *this->_allocator);
-  this->inputNames = std::make_shared<const char*>(inputName.release());
-  this->outputNames = std::make_shared<const char*>(outputName.release());
+  this->loadIO();
+}
+
+void Model::loadSession(const std::string& model, const std::string& optimizedPath){
+  auto start = std::chrono::steady_clock::now();
+  size_t residentBefore = residentBytes();
+  this->_path = model;
+  auto open = [this](const std::string& path, const Ort::SessionOptions& options){
+    std::shared_ptr<MappedFile> mapping;
+    this->_session = this->openSession(path, options, mapping);
+    this->_mapping = mapping;
+  };
+  this->_loadStats = LoadStats();
+  this->_loadStats.cachePath = optimizedPath;
+  if (!optimizedPath.empty() && std::filesystem::exists(optimizedPath)){
+    // Already optimized, skip graph transforms at load.
+    Ort::SessionOptions options = this->_sessionOptions->Clone();
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+    try {
+      open(optimizedPath, options);
+      this->_loadStats.cacheHit = true;
+    }
+    catch (std::exception& exception) {
+      // ORT failures, or a MappedFile that cannot be opened.
+      std::cout << "Dropping unreadable cached model " << optimizedPath << ": " << exception.what() << std::endl;
+      std::error_code error;
+      std::filesystem::remove(optimizedPath, error);
+    }
+  }
+  if (!this->_loadStats.cacheHit){
+    if (optimizedPath.empty()){
+      open(model, *this->_sessionOptions);
+    } else {
+      // Write next to the cache entry, then publish it with an atomic rename.
+      std::ostringstream pending;
+      pending << optimizedPath << ".tmp." << uniqueSuffix();
+      Ort::SessionOptions options = this->_sessionOptions->Clone();
+      options.SetOptimizedModelFilePath(pending.str().c_str());
+      options.AddConfigEntry("session.save_model_format", "ORT");
+      open(model, options);
+      std::error_code error;
+      std::filesystem::rename(pending.str(), optimizedPath, error);
+      if (error)
+        std::filesystem::remove(pending.str(), error);
+    }
+  }
+  this->_loadStats.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  size_t residentAfter = residentBytes();
+  this->_loadStats.memoryBytes = residentAfter > residentBefore ? residentAfter - residentBefore : 0;
+  this->_lastUsed.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+std::unique_ptr<Ort::Session> Model::openSession(const std::string& path, const Ort::SessionOptions& options, std::shared_ptr<MappedFile>& mapping){
+  if (!this->_mapped){
+    if (this->_prepacked != nullptr)
+      return std::make_unique<Ort::Session>(*this->_env, path.c_str(), options, *this->_prepacked);
+    return std::make_unique<Ort::Session>(*this->_env, path.c_str(), options);
+  }
+  mapping = std::make_shared<MappedFile>(path);
+  Ort::SessionOptions mappedOptions = options.Clone();
+  bool direct = std::filesystem::path(path).extension() == ".ort";
+  if (direct){
+    // Initializers point into the mapping instead of being copied, so
+    // every session of this file shares the same resident pages.
+    mappedOptions.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+    mappedOptions.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+  }
+  std::unique_ptr<Ort::Session> session = this->_prepacked != nullptr
+    ? std::make_unique<Ort::Session>(*this->_env, mapping->data(), mapping->size(), mappedOptions, *this->_prepacked)
+    : std::make_unique<Ort::Session>(*this->_env, mapping->data(), mapping->size(), mappedOptions);
+  // Other formats are copied into the session, keeping the pages would
+  // only double the resident size.
+  if (!direct)
+    mapping.reset();
+  return session;
+}
+
+void Model::loadIO(){
+  auto describe = [](const Ort::TypeInfo& typeInfo, TensorInfo& info){
+    if (typeInfo.GetONNXType() != ONNX_TYPE_TENSOR)
+      return;
+    auto tensorInfo = typeInfo.GetTensorTypeAndShapeInfo();
+    info.shape = tensorInfo.GetShape();
+    info.type = tensorInfo.GetElementType();
+    std::vector<const char*> symbols(info.shape.size(), nullptr);
+    tensorInfo.GetSymbolicDimensions(symbols.data(), symbols.size());
+    for (const char* symbol : symbols)
+      info.symbols.push_back(symbol != nullptr ? symbol : "");
+  };
+  size_t inputCount = this->_session->GetInputCount();
+  this->_inputs.resize(inputCount);
+  for (size_t i = 0; i < inputCount; ++i){
+    this->_inputs[i].name = this->_session->GetInputNameAllocated(i, *this->_allocator).get();
+    describe(this->_session->GetInputTypeInfo(i), this->_inputs[i]);
+  }
+  size_t outputCount = this->_session->GetOutputCount();
+  this->_outputs.resize(outputCount);
+  for (size_t i = 0; i < outputCount; ++i){
+    this->_outputs[i].name = this->_session->GetOutputNameAllocated(i, *this->_allocator).get();
+    describe(this->_session->GetOutputTypeInfo(i), this->_outputs[i]);
+  }
+  if (inputCount == 0 || outputCount == 0)
+    throw std::runtime_error("Model has no inputs or outputs");
+  std::vector<std::string> inputSymbols;
+  for (const TensorInfo& input : this->_inputs)
+    for (const std::string& symbol : input.symbols)
+      if (!symbol.empty())
+        inputSymbols.push_back(symbol);
+  for (TensorInfo& output : this->_outputs){
+    // Scalars and outputs of unknown rank are left unpooled.
+    output.inputSized = output.type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED && !output.shape.empty();
+    for (size_t d = 0; d < output.shape.size() && output.inputSized; ++d)
+      output.inputSized = output.shape[d] >= 0
+        || std::find(inputSymbols.begin(), inputSymbols.end(), output.symbols[d]) != inputSymbols.end();
+  }
+  // Names stay owned by _inputs and _outputs, which never change after load.
+  this->inputNames = std::make_shared<const char*>(this->_inputs[0].name.c_str());
+  this->outputNames = std::make_shared<const char*>(this->_outputs[0].name.c_str());
+}
+
+void Model::touch(){
+  this->_lastUsed.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+  this->_uses.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::chrono::steady_clock::time_point Model::lastUsed() const {
+  return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(this->_lastUsed.load(std::memory_order_relaxed)));
+}
+
+void Model::warmup(int runs){
+  if (runs <= 0)
+    return;
+  Ort::AllocatorWithDefaultOptions allocator;
+  std::vector<std::string> names;
+  std::vector<Ort::Value> inputs;
+  for (const TensorInfo& input : this->_inputs){
+    if (elementSize(input.type) == 0){
+      std::cout << "Skipping warm-up, input " << input.name << " cannot be synthesized" << std::endl;
+      return;
+    }
+    std::vector<int64_t> shape = input.shape;
+    for (int64_t& dim : shape)
+      if (dim < 0)
+        dim = 1;
+    Ort::Value value = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), input.type);
+    std::memset(value.GetTensorMutableRawData(), 0, tensorBytes(value));
+    names.push_back(input.name);
+    inputs.push_back(std::move(value));
+  }
+  for (int i = 0; i < runs; ++i)
+    if (this->run(names, inputs) == nullptr)
+      throw std::runtime_error("Warm-up run failed for " + this->_path);
 }
 
 std::unique_ptr<Ort::SessionOptions> Model::getSessionOptions(
   bool parallel, 
   int graphOpLevel, 
-  int intraThreads, 
-  int interThreads
+  int interThreads, 
+  int intraThreads,
+  bool globalThreads
 ) {
   std::unique_ptr<Ort::SessionOptions> sessionOptions = std::make_unique<Ort::SessionOptions>(Ort::SessionOptions());
   if (parallel)
     sessionOptions->SetExecutionMode(ExecutionMode::ORT_PARALLEL);
   else
     sessionOptions->SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
-  if (intraThreads > 0)
-    sessionOptions->SetIntraOpNumThreads(intraThreads);
-  if (interThreads > 0)
-    sessionOptions->SetInterOpNumThreads(interThreads);
+  if (globalThreads)
+    sessionOptions->DisablePerSessionThreads();
+  else {
+    if (intraThreads > 0)
+      sessionOptions->SetIntraOpNumThreads(intraThreads);
+    if (interThreads > 0)
+      sessionOptions->SetInterOpNumThreads(interThreads);
+  }
   switch (graphOpLevel){
   case 0:
     sessionOptions->SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
@@ -82,13 +363,75 @@ std::shared_ptr<std::vector<Ort::Value>> Model::run(
   const Ort::Value& inputs,
   std::shared_ptr<const char*> outputHead,
   const Ort::RunOptions& runOptions){
-  if (outputHead != nullptr)
-    this->outputNames = outputHead;
   if (this->_session == nullptr)
     throw std::runtime_error("Session is not initialized");
+  // Per-call override, the cached default is never swapped.
+  const char* outputName = outputHead != nullptr ? *outputHead : *this->outputNames;
+  CacheLookup lookup(std::atomic_load(&this->_resultCache), *this->_metrics, &*inputNames, &inputs, 1, &outputName, 1);
+  if (lookup.hit != nullptr)
+    return lookup.hit;
+  InflightGuard guard(this->_inflight);
+  RunRecorder recorder(*this->_metrics);
+  std::shared_ptr<Ort::Session> profiled = this->sampleProfiled();
+  Ort::Session& session = profiled != nullptr ? *profiled : *this->_session;
   try {
-    std::vector<Ort::Value> output_vector = this->_session->Run(runOptions, &*inputNames, &inputs, 1, &*outputNames, 1);
-    return std::make_shared<std::vector<Ort::Value>>(std::move(output_vector));
+    std::shared_ptr<std::vector<Ort::Value>> outputs = this->runPooled(session, runOptions, &*inputNames, &inputs, 1, &outputName, 1);
+    if (outputs == nullptr){
+      std::vector<Ort::Value> output_vector = session.Run(runOptions, &*inputNames, &inputs, 1, &outputName, 1);
+      this->planOutputs(&inputs, 1, &outputName, output_vector);
+      outputs = std::make_shared<std::vector<Ort::Value>>(std::move(output_vector));
+    }
+    lookup.store(*outputs);
+    recorder.succeeded = true;
+    return outputs;
+  }
+  catch (Ort::Exception& exception) {
+    std::cout << "Error: " << exception.what() << std::endl;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<std::vector<Ort::Value>> Model::run(
+  const std::vector<std::string>& inputNames,
+  const std::vector<Ort::Value>& inputs,
+  const std::vector<std::string>& outputNames,
+  const Ort::RunOptions& runOptions){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  if (inputNames.size() != inputs.size())
+    throw std::runtime_error("Input names and values do not match");
+  std::vector<const char*> inputHeads;
+  inputHeads.reserve(inputNames.size());
+  for (const std::string& name : inputNames)
+    inputHeads.push_back(name.c_str());
+  std::vector<const char*> outputHeads;
+  if (outputNames.empty()){
+    for (const TensorInfo& output : this->_outputs)
+      outputHeads.push_back(output.name.c_str());
+  } else {
+    for (const std::string& name : outputNames)
+      outputHeads.push_back(name.c_str());
+  }
+  CacheLookup lookup(
+    std::atomic_load(&this->_resultCache), *this->_metrics, inputHeads.data(), inputs.data(), inputs.size(), outputHeads.data(), outputHeads.size());
+  if (lookup.hit != nullptr)
+    return lookup.hit;
+  InflightGuard guard(this->_inflight);
+  RunRecorder recorder(*this->_metrics);
+  std::shared_ptr<Ort::Session> profiled = this->sampleProfiled();
+  Ort::Session& session = profiled != nullptr ? *profiled : *this->_session;
+  try {
+    std::shared_ptr<std::vector<Ort::Value>> outputs = this->runPooled(
+      session, runOptions, inputHeads.data(), inputs.data(), inputs.size(), outputHeads.data(), outputHeads.size());
+    if (outputs == nullptr){
+      std::vector<Ort::Value> output_vector = session.Run(
+        runOptions, inputHeads.data(), inputs.data(), inputs.size(), outputHeads.data(), outputHeads.size());
+      this->planOutputs(inputs.data(), inputs.size(), outputHeads.data(), output_vector);
+      outputs = std::make_shared<std::vector<Ort::Value>>(std::move(output_vector));
+    }
+    lookup.store(*outputs);
+    recorder.succeeded = true;
+    return outputs;
   }
   catch (Ort::Exception& exception) {
     std::cout << "Error: " << exception.what() << std::endl;
@@ -99,10 +442,412 @@ std::shared_ptr<std::vector<Ort::Value>> Model::run(
 std::future<std::shared_ptr<std::vector<Ort::Value>>> Model::runAsync(
   const Ort::Value& inputs, 
   std::shared_ptr<const char*> outputHead,
-  const Ort::RunOptions runOptions){
-  if (outputHead != nullptr)
-    this->outputNames = outputHead;
+  Ort::RunOptions runOptions){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  std::shared_ptr<Executor> executor = std::atomic_load(&this->_executor);
+  if (executor == nullptr)
+    throw std::runtime_error("No executor is set");
+  // The request owns its input and options so the caller may return early,
+  // and pins the model when it is shared-owned.
+  auto input = std::make_shared<BufferPool::Tensor>();
+  std::shared_ptr<BufferPool> pool = std::atomic_load(&this->_pool);
+  if (pool != nullptr)
+    *input = pool->clone(inputs);
+  else
+    input->value = cloneTensor(inputs, Ort::AllocatorWithDefaultOptions());
+  auto options = std::make_shared<Ort::RunOptions>(std::move(runOptions));
+  std::shared_ptr<Model> self = weak_from_this().lock();
+  auto submitted = std::chrono::steady_clock::now();
+  return executor->submit([this, self, input, outputHead, options, submitted]{
+    this->_metrics->queueWait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - submitted).count());
+    return this->run(input->value, outputHead, *options);
+  });
+}
+
+void Model::runCallback(
+  Ort::Value inputs,
+  RunCallback done,
+  std::shared_ptr<const char*> outputHead,
+  Ort::RunOptions runOptions){
   if (this->_session == nullptr)
     throw std::runtime_error("Session is not initialized");
-  return std::async(std::launch::async, &Model::run, this, std::cref(inputs), std::cref(outputNames), std::cref(runOptions));
-}
\ No newline at end of file
+  std::vector<Ort::Value> values;
+  values.push_back(std::move(inputs));
+  std::vector<std::string> outputNames = {outputHead != nullptr ? *outputHead : *this->outputNames};
+  this->runCallback({*this->inputNames}, std::move(values), std::move(done), std::move(outputNames), std::move(runOptions));
+}
+
+void Model::runCallback(
+  std::vector<std::string> inputNames,
+  std::vector<Ort::Value> inputs,
+  RunCallback done,
+  std::vector<std::string> outputNames,
+  Ort::RunOptions runOptions){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  if (inputNames.size() != inputs.size())
+    throw std::runtime_error("Input names and values do not match");
+  auto run = std::make_unique<CallbackRun>();
+  run->inputNames = std::move(inputNames);
+  run->inputs = std::move(inputs);
+  run->outputNames = std::move(outputNames);
+  if (run->outputNames.empty()){
+    for (const TensorInfo& output : this->_outputs)
+      run->outputNames.push_back(output.name);
+  }
+  run->runOptions = std::move(runOptions);
+  run->done = std::move(done);
+  for (const std::string& name : run->inputNames)
+    run->inputHeads.push_back(name.c_str());
+  for (const std::string& name : run->outputNames)
+    run->outputHeads.push_back(name.c_str());
+  run->lookup.emplace(std::atomic_load(&this->_resultCache), *this->_metrics,
+    run->inputHeads.data(), run->inputs.data(), run->inputs.size(), run->outputHeads.data(), run->outputHeads.size());
+  if (run->lookup->hit != nullptr){
+    std::shared_ptr<std::vector<Ort::Value>> hit = std::move(run->lookup->hit);
+    RunCallback callback = std::move(run->done);
+    run.reset();
+    callback(std::move(hit));
+    return;
+  }
+  run->guard.emplace(this->_inflight);
+  run->recorder.emplace(*this->_metrics);
+  run->profiled = this->sampleProfiled();
+  run->callbacks = &this->_callbacks;
+  run->outputs.reserve(run->outputHeads.size());
+  for (size_t i = 0; i < run->outputHeads.size(); ++i)
+    run->outputs.emplace_back(nullptr);
+  Ort::Session& session = run->profiled != nullptr ? *run->profiled : *this->_session;
+  this->_callbacks.add();
+  try {
+    CallbackRun* request = run.get();
+    session.RunAsync(
+      request->runOptions, request->inputHeads.data(), request->inputs.data(), request->inputs.size(),
+      request->outputHeads.data(), request->outputs.data(), request->outputs.size(), finishCallbackRun, request);
+    // Scheduled, the callback owns the request and may have run already.
+    run.release();
+  }
+  catch (Ort::Exception& exception) {
+    // Not scheduled, the request is still ours.
+    std::cout << "Error: " << exception.what() << std::endl;
+    RunCallback callback = std::move(run->done);
+    run.reset();
+    this->_callbacks.done();
+    callback(nullptr);
+  }
+}
+
+Model::~Model(){
+  // ORT holds the session until every RunAsync has called back.
+  this->_callbacks.wait();
+}
+
+void Model::setExecutor(std::shared_ptr<Executor> executor){
+  std::atomic_store(&this->_executor, std::move(executor));
+}
+
+void Model::setBufferPool(std::shared_ptr<BufferPool> pool){
+  std::atomic_store(&this->_pool, std::move(pool));
+}
+
+void Model::setResultCache(std::shared_ptr<ResultCache> cache){
+  std::atomic_store(&this->_resultCache, std::move(cache));
+}
+
+namespace
+{
+  bool samePlan(
+    const std::vector<std::vector<int64_t>>& planInputs,
+    const std::vector<std::string>& planOutputs,
+    const Ort::Value* inputs,
+    size_t inputCount,
+    const char* const* outputHeads,
+    size_t outputCount){
+    if (planInputs.size() != inputCount || planOutputs.size() != outputCount)
+      return false;
+    for (size_t i = 0; i < outputCount; ++i)
+      if (planOutputs[i] != outputHeads[i])
+        return false;
+    for (size_t i = 0; i < inputCount; ++i)
+      if (!inputs[i].IsTensor() || inputs[i].GetTensorTypeAndShapeInfo().GetShape() != planInputs[i])
+        return false;
+    return true;
+  }
+}
+
+std::shared_ptr<std::vector<Ort::Value>> Model::runPooled(
+  Ort::Session& session,
+  const Ort::RunOptions& runOptions,
+  const char* const* inputHeads,
+  const Ort::Value* inputs,
+  size_t inputCount,
+  const char* const* outputHeads,
+  size_t outputCount){
+  std::shared_ptr<BufferPool> pool = std::atomic_load(&this->_pool);
+  if (pool == nullptr || !this->_planOutputs.load(std::memory_order_relaxed))
+    return nullptr;
+  std::shared_ptr<const OutputPlan> plan = std::atomic_load(&this->_outputPlan);
+  if (plan == nullptr || !samePlan(plan->inputs, plan->outputs, inputs, inputCount, outputHeads, outputCount))
+    return nullptr;
+  auto outputs = std::make_shared<PooledOutputs>();
+  outputs->buffers.reserve(outputCount);
+  outputs->values.reserve(outputCount);
+  for (size_t i = 0; i < outputCount; ++i){
+    BufferPool::Tensor tensor = pool->tensor(plan->types[i], plan->shapes[i]);
+    outputs->buffers.push_back(std::move(tensor.buffer));
+    outputs->values.push_back(std::move(tensor.value));
+  }
+  try {
+    session.Run(runOptions, inputHeads, inputs, inputCount, outputHeads, outputs->values.data(), outputCount);
+  }
+  catch (Ort::Exception&) {
+    // Pooling stops for good and the caller runs once unpooled, a real
+    // failure then shows there.
+    this->_planOutputs.store(false, std::memory_order_relaxed);
+    std::atomic_store(&this->_outputPlan, std::shared_ptr<const OutputPlan>());
+    return nullptr;
+  }
+  return std::shared_ptr<std::vector<Ort::Value>>(outputs, &outputs->values);
+}
+
+void Model::planOutputs(
+  const Ort::Value* inputs,
+  size_t inputCount,
+  const char* const* outputHeads,
+  const std::vector<Ort::Value>& outputs){
+  if (std::atomic_load(&this->_pool) == nullptr || !this->_planOutputs.load(std::memory_order_relaxed))
+    return;
+  // Outputs sized by the data would not fit the next run.
+  for (size_t i = 0; i < outputs.size(); ++i){
+    auto output = std::find_if(this->_outputs.begin(), this->_outputs.end(), [&](const TensorInfo& info){ return info.name == outputHeads[i]; });
+    if (output == this->_outputs.end() || !output->inputSized)
+      return;
+  }
+  auto plan = std::make_shared<OutputPlan>();
+  for (const Ort::Value& output : outputs){
+    if (!output.IsTensor())
+      return;
+    auto info = output.GetTensorTypeAndShapeInfo();
+    if (elementSize(info.GetElementType()) == 0)
+      return;
+    plan->shapes.push_back(info.GetShape());
+    plan->types.push_back(info.GetElementType());
+  }
+  std::shared_ptr<const OutputPlan> previous = std::atomic_load(&this->_outputPlan);
+  if (previous != nullptr && samePlan(previous->inputs, previous->outputs, inputs, inputCount, outputHeads, outputs.size())){
+    if (previous->shapes != plan->shapes){
+      this->_planOutputs.store(false, std::memory_order_relaxed);
+      std::atomic_store(&this->_outputPlan, std::shared_ptr<const OutputPlan>());
+    }
+    return;
+  }
+  for (size_t i = 0; i < inputCount; ++i)
+    plan->inputs.push_back(inputs[i].GetTensorTypeAndShapeInfo().GetShape());
+  for (size_t i = 0; i < outputs.size(); ++i)
+    plan->outputs.push_back(outputHeads[i]);
+  std::atomic_store(&this->_outputPlan, std::shared_ptr<const OutputPlan>(std::move(plan)));
+}
+
+std::shared_ptr<Ort::Session> Model::sampleProfiled(){
+  uint32_t every = this->_profileEvery.load(std::memory_order_relaxed);
+  if (every == 0 || this->_profileTick.fetch_add(1, std::memory_order_relaxed) % every != 0)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(this->_profileMutex);
+  if (this->_profiled == nullptr)
+    return nullptr;
+  // Counted until the run drops the session, stopProfiling waits for it.
+  this->_profileRuns.add();
+  std::shared_ptr<Ort::Session> profiled = this->_profiled;
+  return std::shared_ptr<Ort::Session>(profiled.get(), [this, profiled](Ort::Session*){ this->_profileRuns.done(); });
+}
+
+void Model::setProfiling(uint32_t every, const std::string& prefix){
+  this->stopProfiling();
+  if (every == 0)
+    return;
+  // Same file and options as the serving session, cached graphs are not
+  // optimized again.
+  Ort::SessionOptions options = this->_sessionOptions->Clone();
+  std::string path = this->_path;
+  if (this->_loadStats.cacheHit){
+    path = this->_loadStats.cachePath;
+    options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+  }
+  options.EnableProfiling(prefix.c_str());
+  std::shared_ptr<MappedFile> mapping;
+  std::unique_ptr<Ort::Session> session = this->openSession(path, options, mapping);
+  std::shared_ptr<Ort::Session> profiled(session.release(), [mapping](Ort::Session* session){ delete session; });
+  {
+    std::lock_guard<std::mutex> lock(this->_profileMutex);
+    this->_profiled = profiled;
+  }
+  this->_profileTick.store(0, std::memory_order_relaxed);
+  this->_profileEvery.store(every, std::memory_order_relaxed);
+}
+
+std::string Model::stopProfiling(){
+  this->_profileEvery.store(0, std::memory_order_relaxed);
+  std::shared_ptr<Ort::Session> profiled;
+  {
+    std::lock_guard<std::mutex> lock(this->_profileMutex);
+    profiled.swap(this->_profiled);
+  }
+  if (profiled == nullptr)
+    return "";
+  // No run can sample the session anymore, wait for those that did.
+  this->_profileRuns.wait();
+  Ort::AllocatorWithDefaultOptions allocator;
+  return profiled->EndProfilingAllocated(allocator).get();
+}
+
+std::vector<NodePlacement> Model::getNodePlacement(){
+  // ORT has no query for the partitioning, the profiler records the
+  // provider of every kernel run.
+  this->setProfiling(1, "cinnamon_placement");
+  this->warmup(1);
+  std::string trace = this->stopProfiling();
+  std::vector<NodePlacement> placement = readPlacement(trace);
+  std::error_code error;
+  std::filesystem::remove(trace, error);
+  return placement;
+}
+
+std::unique_ptr<Binding> Model::createBinding(){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  return std::make_unique<Binding>(*this->_session, weak_from_this().lock());
+}
+
+std::unique_ptr<Binding> Model::createBinding(const Ort::Value& inputs, const Ort::Value* outputs){
+  std::unique_ptr<Binding> binding = this->createBinding();
+  binding->bindInput(*this->inputNames, inputs);
+  if (outputs != nullptr)
+    binding->bindOutput(*this->outputNames, *outputs);
+  else
+    binding->bindOutput(*this->outputNames);
+  return binding;
+}
+
+void Model::enableBatching(size_t maxBatchSize, int maxWaitMicros){
+  std::atomic_store(&this->_batcher, std::make_shared<Batcher>(this, maxBatchSize, std::chrono::microseconds(maxWaitMicros)));
+}
+
+void Model::disableBatching(){
+  // The batcher drains its queue once the last submitter lets it go.
+  std::atomic_store(&this->_batcher, std::shared_ptr<Batcher>());
+}
+
+std::future<std::shared_ptr<std::vector<Ort::Value>>> Model::runBatched(const Ort::Value& inputs){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  std::shared_ptr<Batcher> batcher = std::atomic_load(&this->_batcher);
+  if (batcher == nullptr)
+    throw std::runtime_error("Batching is not enabled");
+  return batcher->submit(inputs);
+}
+
+void Model::enableShapeBuckets(const BucketOptions& options){
+  this->_buckets = std::make_unique<ShapeBuckets>(this, options);
+}
+
+void Model::disableShapeBuckets(){
+  this->_buckets.reset();
+}
+
+BucketedOutputs Model::runBucketed(const std::vector<ImageView>& images, const Ort::RunOptions& runOptions){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  if (this->_buckets == nullptr)
+    throw std::runtime_error("Shape buckets are not enabled");
+  return this->_buckets->run(images, runOptions);
+}
+
+void Model::enableScheduling(const SchedulerOptions& options, std::shared_ptr<SchedulerPool> pool){
+  this->_scheduler = std::make_unique<Scheduler>(this, options, std::move(pool));
+}
+
+void Model::disableScheduling(){
+  this->_scheduler.reset();
+}
+
+std::future<std::shared_ptr<std::vector<Ort::Value>>> Model::runScheduled(
+  const Ort::Value& inputs,
+  const RequestOptions& request,
+  std::shared_ptr<const char*> outputHead,
+  Ort::RunOptions runOptions){
+  if (this->_session == nullptr)
+    throw std::runtime_error("Session is not initialized");
+  if (this->_scheduler == nullptr)
+    throw std::runtime_error("Scheduling is not enabled");
+  return this->_scheduler->submit(inputs, request, outputHead, std::move(runOptions));
+}
+
+void Model::runBound(Binding& binding, const Ort::RunOptions& runOptions){
+  InflightGuard guard(this->_inflight);
+  RunRecorder recorder(*this->_metrics);
+  binding.run(runOptions);
+  recorder.succeeded = true;
+}
+
+Ort::Value& Model::preprocess(const std::vector<ImageView>& images, std::vector<int64_t> shape, const PreprocessOptions& options){
+  if (shape.empty() && !this->_inputs.empty()){
+    shape = this->_inputs.front().shape;
+    if (!shape.empty() && shape[0] < 0)
+      shape[0] = static_cast<int64_t>(images.size());
+  }
+  if (shape.size() < 3)
+    throw std::runtime_error("Preprocess needs a [..., C, H, W] shape");
+  int64_t count = 1;
+  for (int64_t dim : shape){
+    if (dim < 0)
+      throw std::runtime_error("Preprocess shape has dynamic dimensions");
+    count *= dim;
+  }
+  const int64_t height = shape[shape.size() - 2];
+  const int64_t width = shape[shape.size() - 1];
+  if (count != static_cast<int64_t>(images.size()) * 3 * height * width)
+    throw std::runtime_error("Preprocess shape does not match 3 channels per image");
+
+  ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+  if (!this->_inputs.empty() && this->_inputs.front().type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED)
+    type = this->_inputs.front().type;
+  PreprocessOptions pixels = options;
+  switch (type){
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+    break;
+  case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    for (int c = 0; c < 3; ++c){
+      if (options.mean[c] != 0.f || options.std[c] != 1.f)
+        throw std::runtime_error("Preprocess cannot normalize uint8 inputs");
+      // Undoes the division by 255, values stay whole pixels.
+      pixels.std[c] = 1.f / 255.f;
+    }
+    break;
+  default:
+    throw std::runtime_error("Preprocess does not support the type of input " + this->_inputs.front().name);
+  }
+
+  if (!this->_inputBuffer || this->_inputBuffer.GetTensorTypeAndShapeInfo().GetShape() != shape
+    || this->_inputBuffer.GetTensorTypeAndShapeInfo().GetElementType() != type){
+    Ort::AllocatorWithDefaultOptions allocator;
+    this->_inputBuffer = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), type);
+  }
+  if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT){
+    imagesToTensor(images, this->_inputBuffer.GetTensorMutableData<float>(), static_cast<int>(width), static_cast<int>(height), options);
+    return this->_inputBuffer;
+  }
+  this->_inputScratch.resize(static_cast<size_t>(count));
+  imagesToTensor(images, this->_inputScratch.data(), static_cast<int>(width), static_cast<int>(height), pixels);
+  if (type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16){
+    uint16_t* dst = static_cast<uint16_t*>(this->_inputBuffer.GetTensorMutableRawData());
+    for (size_t i = 0; i < this->_inputScratch.size(); ++i)
+      dst[i] = toHalf(this->_inputScratch[i]);
+  } else {
+    uint8_t* dst = static_cast<uint8_t*>(this->_inputBuffer.GetTensorMutableRawData());
+    for (size_t i = 0; i < this->_inputScratch.size(); ++i)
+      dst[i] = static_cast<uint8_t>(std::lround(std::min(std::max(this->_inputScratch[i], 0.f), 255.f)));
+  }
+  return this->_inputBuffer;
+}
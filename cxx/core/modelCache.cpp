@@ -0,0 +1,37 @@
+#include "modelCache.h"
+#include "hash.h"
+#include <filesystem>
+#include <cstdio>
+#include <onnxruntime_cxx_api.h>
+
+using namespace cinrt::model;
+
+ModelCache::ModelCache(std::string dir) : _dir(std::move(dir)) {
+  std::filesystem::create_directories(_dir);
+}
+
+uint64_t ModelCache::fileHash(const std::string& model){
+  int64_t size = static_cast<int64_t>(std::filesystem::file_size(model));
+  int64_t mtime = std::filesystem::last_write_time(model).time_since_epoch().count();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _hashes.find(model);
+    if (it != _hashes.end() && it->second.size == size && it->second.mtime == mtime)
+      return it->second.hash;
+  }
+  uint64_t hash = hashFile(model);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _hashes[model] = {size, mtime, hash};
+  return hash;
+}
+
+std::string ModelCache::path(const std::string& model, bool parallel, int graphOpLevel){
+  std::string options = std::string(OrtGetApiBase()->GetVersionString())
+    + ";parallel=" + std::to_string(parallel)
+    + ";level=" + std::to_string(graphOpLevel);
+  uint64_t key = hash64(options.data(), options.size(), fileHash(model));
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+  std::string name = std::filesystem::path(model).stem().string() + "-" + hex + ".ort";
+  return (std::filesystem::path(_dir) / name).string();
+}
@@ -0,0 +1,398 @@
+#include "modelGraph.h"
+#include "core.h"
+#include "tensor.h"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <set>
+#include <stdexcept>
+
+using namespace cinrt::model;
+
+const GraphValues::Slot& GraphValues::find(const std::string& name, Kind kind) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _slots.find(name);
+  if (it == _slots.end())
+    throw std::runtime_error("Missing graph value: " + name);
+  if (it->second.kind != kind)
+    throw std::runtime_error("Graph value of another kind: " + name);
+  // Slots are never moved nor rewritten once inserted.
+  return it->second;
+}
+
+void GraphValues::insert(const std::string& name, Slot slot){
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_slots.emplace(name, std::move(slot)).second)
+    throw std::runtime_error("Graph value written twice: " + name);
+}
+
+bool GraphValues::has(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _slots.count(name) > 0;
+}
+
+const Ort::Value& GraphValues::tensor(const std::string& name) const {
+  return *find(name, Kind::Tensor).tensor;
+}
+
+const ImageView& GraphValues::image(const std::string& name) const {
+  return find(name, Kind::Image).image;
+}
+
+const Detections& GraphValues::detections(const std::string& name) const {
+  return *find(name, Kind::Detections).detections;
+}
+
+const std::vector<Rescale>& GraphValues::scales(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _scales.find(name);
+  if (it == _scales.end())
+    throw std::runtime_error("Missing graph scales: " + name);
+  return it->second;
+}
+
+void GraphValues::setTensor(const std::string& name, Ort::Value value){
+  auto owner = std::make_shared<Ort::Value>(std::move(value));
+  Slot slot;
+  slot.kind = Kind::Tensor;
+  slot.tensor = owner.get();
+  slot.owner = owner;
+  insert(name, std::move(slot));
+}
+
+void GraphValues::setTensor(const std::string& name, BufferPool::Tensor tensor){
+  auto owner = std::make_shared<BufferPool::Tensor>(std::move(tensor));
+  Slot slot;
+  slot.kind = Kind::Tensor;
+  slot.tensor = &owner->value;
+  slot.owner = owner;
+  insert(name, std::move(slot));
+}
+
+void GraphValues::setTensor(const std::string& name, std::shared_ptr<std::vector<Ort::Value>> outputs, size_t index){
+  if (outputs == nullptr || index >= outputs->size())
+    throw std::runtime_error("Invalid output for graph value: " + name);
+  Slot slot;
+  slot.kind = Kind::Tensor;
+  slot.tensor = &(*outputs)[index];
+  slot.owner = std::move(outputs);
+  insert(name, std::move(slot));
+}
+
+void GraphValues::setImage(const std::string& name, const ImageView& image){
+  Slot slot;
+  slot.kind = Kind::Image;
+  slot.image = image;
+  insert(name, std::move(slot));
+}
+
+void GraphValues::setDetections(const std::string& name, Detections detections){
+  Slot slot;
+  slot.kind = Kind::Detections;
+  slot.detections = std::make_shared<const Detections>(std::move(detections));
+  insert(name, std::move(slot));
+}
+
+void GraphValues::setScales(const std::string& name, std::vector<Rescale> scales){
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (!_scales.emplace(name, std::move(scales)).second)
+    throw std::runtime_error("Graph scales written twice: " + name);
+}
+
+// Nodes left to run in one ModelGraph::run. Shared with the executor
+// tasks, which may start after the run returned and then find nothing.
+struct ModelGraph::RunState
+{
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<size_t> pending;
+  std::vector<size_t> ready;
+  size_t running = 0;
+  std::exception_ptr error;
+};
+
+ModelGraph::ModelGraph(modelManager& manager, std::shared_ptr<Executor> executor)
+  : _manager(manager), _executor(std::move(executor)), _memoryInfo(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault)) {
+  if (_executor == nullptr)
+    _executor = Executor::shared();
+}
+
+void ModelGraph::add(Node node){
+  for (const Node& other : _nodes)
+    if (other.name == node.name)
+      throw std::runtime_error("Graph node added twice: " + node.name);
+  for (const std::string& output : node.outputs)
+    if (_producers.count(output) > 0 || std::count(node.outputs.begin(), node.outputs.end(), output) > 1)
+      throw std::runtime_error("Graph value written by two nodes: " + output);
+  std::vector<Node> nodes = _nodes;
+  std::map<std::string, size_t> producers = _producers;
+  for (const std::string& output : node.outputs)
+    producers[output] = nodes.size();
+  nodes.push_back(std::move(node));
+  for (Node& each : nodes){
+    each.dependents.clear();
+    each.dependencies = 0;
+  }
+  for (size_t i = 0; i < nodes.size(); ++i){
+    std::set<size_t> sources;
+    for (const std::string& input : nodes[i].inputs){
+      auto it = producers.find(input);
+      if (it != producers.end())
+        sources.insert(it->second);
+    }
+    for (size_t source : sources){
+      nodes[source].dependents.push_back(i);
+      ++nodes[i].dependencies;
+    }
+  }
+  // Every node must be reachable from the nodes without dependencies.
+  std::vector<size_t> pending(nodes.size());
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < nodes.size(); ++i){
+    pending[i] = nodes[i].dependencies;
+    if (pending[i] == 0)
+      ready.push_back(i);
+  }
+  size_t ordered = 0;
+  while (!ready.empty()){
+    size_t index = ready.back();
+    ready.pop_back();
+    ++ordered;
+    for (size_t dependent : nodes[index].dependents)
+      if (--pending[dependent] == 0)
+        ready.push_back(dependent);
+  }
+  if (ordered != nodes.size())
+    throw std::runtime_error("Graph node closes a cycle: " + nodes.back().name);
+  _nodes = std::move(nodes);
+  _producers = std::move(producers);
+}
+
+ModelGraph& ModelGraph::addModel(
+  const std::string& node,
+  const std::string& model,
+  const std::map<std::string, std::string>& inputs,
+  const std::map<std::string, std::string>& outputs){
+  std::shared_ptr<Model> loaded = _manager.acquireModel(model);
+  if (loaded == nullptr)
+    throw std::runtime_error("Model not found: " + model);
+  auto known = [](const std::vector<TensorInfo>& tensors, const std::string& name){
+    return std::any_of(tensors.begin(), tensors.end(), [&](const TensorInfo& tensor){ return tensor.name == name; });
+  };
+  for (const auto& entry : inputs)
+    if (!known(loaded->getInputs(), entry.first))
+      throw std::runtime_error("Unknown input " + entry.first + " of " + model + " in graph node " + node);
+  for (const auto& entry : outputs)
+    if (!known(loaded->getOutputs(), entry.first))
+      throw std::runtime_error("Unknown output " + entry.first + " of " + model + " in graph node " + node);
+  Node added;
+  added.name = node;
+  added.kind = NodeKind::Model;
+  added.model = model;
+  for (const TensorInfo& input : loaded->getInputs()){
+    auto it = inputs.find(input.name);
+    added.modelInputs.push_back(input.name);
+    added.inputs.push_back(it != inputs.end() ? it->second : input.name);
+  }
+  for (const TensorInfo& output : loaded->getOutputs()){
+    auto it = outputs.find(output.name);
+    if (!outputs.empty() && it == outputs.end())
+      continue;
+    added.modelOutputs.push_back(output.name);
+    added.outputs.push_back(it != outputs.end() ? it->second : output.name);
+  }
+  add(std::move(added));
+  return *this;
+}
+
+ModelGraph& ModelGraph::addCrops(
+  const std::string& node,
+  const std::string& image,
+  const std::string& detections,
+  const std::string& output,
+  const CropOptions& options){
+  if (options.width <= 0 || options.height <= 0)
+    throw std::runtime_error("Crops need a size in graph node " + node);
+  Node added;
+  added.name = node;
+  added.kind = NodeKind::Crops;
+  added.inputs = {image, detections};
+  added.outputs = {output};
+  added.crop = options;
+  add(std::move(added));
+  return *this;
+}
+
+ModelGraph& ModelGraph::addFunction(
+  const std::string& node,
+  const std::vector<std::string>& inputs,
+  const std::vector<std::string>& outputs,
+  GraphFunction function){
+  Node added;
+  added.name = node;
+  added.kind = NodeKind::Function;
+  added.inputs = inputs;
+  added.outputs = outputs;
+  added.function = std::move(function);
+  add(std::move(added));
+  return *this;
+}
+
+std::vector<std::string> ModelGraph::inputs() const {
+  std::set<std::string> inputs;
+  for (const Node& node : _nodes)
+    for (const std::string& input : node.inputs)
+      if (_producers.count(input) == 0)
+        inputs.insert(input);
+  return std::vector<std::string>(inputs.begin(), inputs.end());
+}
+
+void ModelGraph::run(GraphValues& values) const {
+  for (const std::string& input : inputs())
+    if (!values.has(input))
+      throw std::runtime_error("Missing graph input: " + input);
+  auto state = std::make_shared<RunState>();
+  state->pending.resize(_nodes.size());
+  for (size_t i = 0; i < _nodes.size(); ++i){
+    state->pending[i] = _nodes[i].dependencies;
+    if (state->pending[i] == 0)
+      state->ready.push_back(i);
+  }
+  // Helpers for the other ready nodes, this thread takes one.
+  for (size_t i = 1; i < state->ready.size(); ++i)
+    _executor->post([this, state, &values]{ while (step(state, values)) {} });
+  while (true){
+    if (step(state, values))
+      continue;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->changed.wait(lock, [&]{ return state->running == 0 || (!state->ready.empty() && !state->error); });
+    if (state->running == 0 && (state->ready.empty() || state->error))
+      break;
+  }
+  if (state->error)
+    std::rethrow_exception(state->error);
+}
+
+bool ModelGraph::step(const std::shared_ptr<RunState>& state, GraphValues& values) const {
+  size_t index;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->ready.empty() || state->error)
+      return false;
+    index = state->ready.back();
+    state->ready.pop_back();
+    ++state->running;
+  }
+  std::exception_ptr failure;
+  try {
+    runNode(_nodes[index], values);
+  }
+  catch (...) {
+    failure = std::current_exception();
+  }
+  size_t helpers = 0;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (failure && !state->error)
+      state->error = failure;
+    size_t before = state->ready.size();
+    for (size_t dependent : _nodes[index].dependents)
+      if (--state->pending[dependent] == 0)
+        state->ready.push_back(dependent);
+    // This thread goes on with one of the new ready nodes.
+    if (state->ready.size() > before + 1 && !state->error)
+      helpers = state->ready.size() - before - 1;
+    --state->running;
+    state->changed.notify_all();
+  }
+  for (size_t i = 0; i < helpers; ++i)
+    _executor->post([this, state, &values]{ while (step(state, values)) {} });
+  return true;
+}
+
+void ModelGraph::runNode(const Node& node, GraphValues& values) const {
+  // Skipped with everything downstream when an input was not produced.
+  for (const std::string& input : node.inputs)
+    if (!values.has(input))
+      return;
+  if (node.kind == NodeKind::Model)
+    runModel(node, values);
+  else if (node.kind == NodeKind::Crops)
+    runCrops(node, values);
+  else
+    node.function(values);
+}
+
+void ModelGraph::runModel(const Node& node, GraphValues& values) const {
+  std::shared_ptr<Model> model = _manager.acquireModel(node.model);
+  if (model == nullptr)
+    throw std::runtime_error("Model not found: " + node.model);
+  // Views of the values, the session reads them in place.
+  std::vector<Ort::Value> inputs;
+  inputs.reserve(node.inputs.size());
+  for (const std::string& name : node.inputs){
+    const Ort::Value& value = values.tensor(name);
+    auto info = value.GetTensorTypeAndShapeInfo();
+    const ONNXTensorElementDataType type = info.GetElementType();
+    if (elementSize(type) == 0)
+      throw std::runtime_error("Graph value is not a dense tensor: " + name);
+    const std::vector<int64_t> shape = info.GetShape();
+    inputs.push_back(Ort::Value::CreateTensor(
+      _memoryInfo, const_cast<void*>(value.GetTensorRawData()), tensorBytes(value), shape.data(), shape.size(), type));
+  }
+  std::shared_ptr<std::vector<Ort::Value>> outputs = model->run(node.modelInputs, inputs, node.modelOutputs);
+  if (outputs == nullptr)
+    throw std::runtime_error("Inference failed in graph node " + node.name);
+  for (size_t i = 0; i < node.outputs.size(); ++i)
+    values.setTensor(node.outputs[i], outputs, i);
+}
+
+void ModelGraph::runCrops(const Node& node, GraphValues& values) const {
+  const ImageView& image = values.image(node.inputs[0]);
+  const Detections& boxes = values.detections(node.inputs[1]);
+  const CropOptions& options = node.crop;
+  size_t count = boxes.size();
+  if (options.maxCrops > 0)
+    count = std::min(count, options.maxCrops);
+  if (count == 0 || image.data == nullptr || image.width <= 0 || image.height <= 0)
+    return;
+  const std::vector<int64_t> shape = {static_cast<int64_t>(count), 3, options.height, options.width};
+  std::shared_ptr<BufferPool> pool = _manager.getBufferPool();
+  BufferPool::Tensor tensor;
+  if (pool != nullptr)
+    tensor = pool->tensor<float>(shape);
+  else
+    tensor.value = Ort::Value::CreateTensor<float>(Ort::AllocatorWithDefaultOptions(), shape.data(), shape.size());
+  float* dst = tensor.value.GetTensorMutableData<float>();
+  const size_t plane = static_cast<size_t>(3) * options.width * options.height;
+  const size_t stride = image.stride > 0 ? image.stride : static_cast<size_t>(image.width) * 3;
+  std::vector<Rescale> scales;
+  scales.reserve(count);
+  for (size_t i = 0; i < count; ++i){
+    const float marginX = (boxes.x1[i] - boxes.x0[i]) * options.margin;
+    const float marginY = (boxes.y1[i] - boxes.y0[i]) * options.margin;
+    const int x0 = std::clamp(static_cast<int>(std::floor(boxes.x0[i] - marginX)), 0, image.width - 1);
+    const int y0 = std::clamp(static_cast<int>(std::floor(boxes.y0[i] - marginY)), 0, image.height - 1);
+    const int x1 = std::clamp(static_cast<int>(std::ceil(boxes.x1[i] + marginX)), x0 + 1, image.width);
+    const int y1 = std::clamp(static_cast<int>(std::ceil(boxes.y1[i] + marginY)), y0 + 1, image.height);
+    // The crop is a view into the image, resized straight into its row.
+    const ImageView crop{image.data + static_cast<size_t>(y0) * stride + static_cast<size_t>(x0) * 3, x1 - x0, y1 - y0, stride};
+    Rescale scale;
+    if (options.letterbox){
+      Letterbox box = Letterbox::fit(crop.width, crop.height, options.width, options.height);
+      letterboxToTensor(crop, dst + i * plane, options.width, options.height, box, options.preprocess);
+      scale = Rescale::letterbox(box, crop.width, crop.height);
+    } else {
+      imageToTensor(crop, dst + i * plane, options.width, options.height, options.preprocess);
+      scale = Rescale::stretch(options.width, options.height, crop.width, crop.height);
+    }
+    // Maps to image pixels rather than crop pixels.
+    scale.padX -= x0 * scale.scaleX;
+    scale.padY -= y0 * scale.scaleY;
+    scale.width = static_cast<float>(image.width);
+    scale.height = static_cast<float>(image.height);
+    scales.push_back(scale);
+  }
+  values.setScales(node.outputs[0], std::move(scales));
+  values.setTensor(node.outputs[0], std::move(tensor));
+}
@@ -1,45 +1,424 @@
 #include <iostream>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
 #include "core.h"
+#include "resources.h"
 #include <onnxruntime_cxx_api.h>
 
 using namespace cinrt::model;
 
 modelManager::modelManager(std::shared_ptr<Ort::Env> env) : _env(std::move(env)){}
 
+modelManager::modelManager(const ThreadPoolOptions& threadPool){
+    Ort::ThreadingOptions threadingOptions;
+    if (threadPool.intraThreads > 0)
+        threadingOptions.SetGlobalIntraOpNumThreads(threadPool.intraThreads);
+    if (threadPool.interThreads > 0)
+        threadingOptions.SetGlobalInterOpNumThreads(threadPool.interThreads);
+    threadingOptions.SetGlobalSpinControl(threadPool.spinning ? 1 : 0);
+    if (threadPool.denormalAsZero)
+        threadingOptions.SetGlobalDenormalAsZero();
+    if (!threadPool.intraAffinities.empty())
+        Ort::ThrowOnError(Ort::GetApi().SetGlobalIntraOpThreadAffinity(threadingOptions, threadPool.intraAffinities.c_str()));
+    this->_env = std::make_shared<Ort::Env>(threadingOptions, ORT_LOGGING_LEVEL_WARNING, "cinrt");
+    this->_globalThreads = true;
+    this->_executor = Executor::forSessions(threadPool.intraThreads);
+}
+
 modelManager::~modelManager(){
+    _endpoint.reset();
+    _server.reset();
+    // Finish queued loads before the models and env go away.
+    _loader.reset();
     _models.clear();
 }
 
+std::vector<std::shared_ptr<Model>> modelManager::buildModels(
+    const std::string& model,
+    bool parallel,
+    int graphOpLevel,
+    int interThreads,
+    int intraThreads,
+    int replicas,
+    const std::vector<ExecutionProvider>& providers){
+    if (replicas < 1)
+        replicas = 1;
+    if (replicas > 1 && !this->_globalThreads){
+        // Partition the thread budget so replicas do not oversubscribe cores.
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        intraThreads = std::max(1, (intraThreads > 0 ? intraThreads : cores) / replicas);
+        if (parallel)
+            interThreads = std::max(1, (interThreads > 0 ? interThreads : cores) / replicas);
+    }
+    std::shared_ptr<Ort::PrepackedWeightsContainer> prepacked;
+    {
+        std::lock_guard<std::mutex> lock(this->_modelsMutex);
+        std::shared_ptr<Ort::PrepackedWeightsContainer>& shared = this->_prepacked[model];
+        if (shared == nullptr)
+            shared = std::make_shared<Ort::PrepackedWeightsContainer>();
+        prepacked = shared;
+    }
+    // Graph optimization is only worth caching when it is enabled. The first
+    // replica fills the cache entry, the next ones load it.
+    std::string optimizedPath;
+    // Graphs partitioned for other providers may hold compiled nodes, which
+    // ORT cannot save.
+    bool cpuOnly = std::all_of(providers.begin(), providers.end(), [](const ExecutionProvider& provider){
+        return providerName(provider.name) == "CPUExecutionProvider";
+    });
+    if (this->_cache != nullptr && graphOpLevel > 0 && cpuOnly)
+        optimizedPath = this->_cache->path(model, parallel, graphOpLevel);
+    // Each model builds its own session allocator, no throwaway session is needed.
+    std::vector<std::shared_ptr<Model>> newModels;
+    for (int i = 0; i < replicas; ++i){
+        newModels.push_back(Model::create(_env, _allocator, model, parallel, graphOpLevel, interThreads, intraThreads, prepacked, this->_globalThreads, optimizedPath, this->_mapped, providers));
+        newModels.back()->setBufferPool(this->_pool);
+        if (this->_executor != nullptr)
+            newModels.back()->setExecutor(this->_executor);
+        if (this->_scheduling != nullptr)
+            newModels.back()->enableScheduling(*this->_scheduling, this->_schedulerPool);
+    }
+    return newModels;
+}
+
 Model* modelManager::createModel(
     std::string model, 
     bool parallel, 
     int graphOpLevel,
     int interThreads, 
-    int intraThreads){
-    std::unique_ptr<Ort::SessionOptions> _sessionOptions = Model::getSessionOptions(parallel, graphOpLevel, interThreads, intraThreads);
-    std::unique_ptr<Ort::Session> _session = std::make_unique<Ort::Session>(*_env, model.c_str(), *_sessionOptions);
-    this->_allocator = std::make_shared<Ort::Allocator>(*_session, Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault));
-    std::shared_ptr<Model> newModel = Model::create(_env, _allocator, model, parallel, graphOpLevel, interThreads, intraThreads);
+    int intraThreads,
+    int replicas,
+    const std::vector<ExecutionProvider>& providers){
+    std::vector<std::shared_ptr<Model>> newModels = buildModels(model, parallel, graphOpLevel, interThreads, intraThreads, replicas, providers);
     // std::shared_ptr<Model> newModel = Model::(_env, _allocator, model, parallel, graphOpLevel, interThreads, intraThreads);
-    this->_models[model] = newModel;
-    return newModel.get();
+    attachMetrics(model, newModels);
+    this->_models.publish(model, newModels);
+    onModelLoaded(model);
+    return newModels.front().get();
 }
 
-Model* modelManager::getModel(std::string model){
-    auto it = this->_models.find(model);
-    if (it != this->_models.end()){
-        return it->second.get();
-    } else {
-        std::cout << "Model not found" << std::endl;
+std::shared_future<Model*> modelManager::preloadModel(
+    std::string model,
+    bool parallel,
+    int graphOpLevel,
+    int interThreads,
+    int intraThreads,
+    int replicas,
+    int warmupRuns,
+    const std::vector<ExecutionProvider>& providers){
+    std::lock_guard<std::mutex> lock(this->_modelsMutex);
+    auto pending = this->_pending.find(model);
+    if (pending != this->_pending.end())
+        return pending->second;
+    // Already loaded, do not build and publish it a second time.
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found != nullptr && !found->empty()){
+        std::promise<Model*> loaded;
+        loaded.set_value(found->front().get());
+        return loaded.get_future().share();
+    }
+    if (this->_loader == nullptr)
+        this->_loader = std::make_shared<Executor>(2);
+    std::shared_future<Model*> ready = this->_loader->submit([=]{
+        try {
+            std::vector<std::shared_ptr<Model>> newModels = buildModels(model, parallel, graphOpLevel, interThreads, intraThreads, replicas, providers);
+            for (std::shared_ptr<Model>& replica : newModels)
+                replica->warmup(warmupRuns);
+            // Only routable once every replica is warm.
+            attachMetrics(model, newModels);
+            this->_models.publish(model, newModels);
+            {
+                std::lock_guard<std::mutex> lock(this->_modelsMutex);
+                this->_pending.erase(model);
+            }
+            onModelLoaded(model);
+            return newModels.front().get();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(this->_modelsMutex);
+            this->_pending.erase(model);
+            throw;
+        }
+    }).share();
+    this->_pending[model] = ready;
+    return ready;
+}
+
+std::shared_ptr<Model> modelManager::pickReplica(const std::string& model){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found == nullptr)
         return nullptr;
+    const ModelRegistry::Replicas& replicas = *found;
+    // Start from a rotating per-thread cursor so equally loaded replicas
+    // share traffic without a shared counter.
+    thread_local size_t cursor = 0;
+    size_t start = cursor++;
+    const std::shared_ptr<Model>* best = nullptr;
+    for (size_t i = 0; i < replicas.size(); ++i){
+        const std::shared_ptr<Model>& replica = replicas[(start + i) % replicas.size()];
+        // Scheduled requests waiting count as load.
+        int load = replica->load() + replica->queued();
+        if (load == 0){
+            best = &replica;
+            break;
+        }
+        if (best == nullptr || load < (*best)->load() + (*best)->queued())
+            best = &replica;
     }
+    (*best)->touch();
+    return *best;
 }
 
-void modelManager::delModel(std::string model){
-    auto it = this->_models.find(model);
-    if (it != this->_models.end()){
-        this->_models.erase(it);
-    } else {
+std::shared_ptr<Model> modelManager::getModel(std::string model){
+    std::shared_ptr<Model> replica = pickReplica(model);
+    if (replica == nullptr)
         std::cout << "Model not found" << std::endl;
+    return replica;
+}
+
+std::shared_ptr<Model> modelManager::acquireModel(std::string model){
+    return pickReplica(model);
+}
+
+Model* modelManager::swapModel(
+    std::string model,
+    std::string version,
+    bool parallel,
+    int graphOpLevel,
+    int interThreads,
+    int intraThreads,
+    int replicas,
+    int warmupRuns,
+    const std::vector<ExecutionProvider>& providers){
+    std::vector<std::shared_ptr<Model>> newModels = buildModels(version, parallel, graphOpLevel, interThreads, intraThreads, replicas, providers);
+    for (std::shared_ptr<Model>& replica : newModels)
+        replica->warmup(warmupRuns);
+    attachMetrics(model, newModels);
+    // Requests already holding the old replicas finish on them.
+    std::shared_ptr<const ModelRegistry::Replicas> previous = this->_models.publish(model, newModels);
+    releasePrepacked(previous, version);
+    onModelLoaded(model);
+    return newModels.front().get();
+}
+
+bool modelManager::isPinned(const std::string& model){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found == nullptr)
+        return false;
+    for (const std::shared_ptr<Model>& replica : *found)
+        if (replica.use_count() > 1 || replica->load() > 0 || replica->queued() > 0)
+            return true;
+    return false;
+}
+
+modelManager::Usage modelManager::getUsage(const std::string& model){
+    Usage usage;
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found == nullptr)
+        return usage;
+    for (const std::shared_ptr<Model>& replica : *found){
+        usage.lastUsed = std::max(usage.lastUsed, replica->lastUsed());
+        usage.uses += replica->uses();
     }
+    return usage;
+}
+
+void modelManager::releasePrepacked(std::shared_ptr<const ModelRegistry::Replicas> replicas, const std::string& keep){
+    if (replicas == nullptr)
+        return;
+    std::lock_guard<std::mutex> lock(this->_modelsMutex);
+    for (const std::shared_ptr<Model>& replica : *replicas)
+        if (replica->getPath() != keep)
+            this->_prepacked.erase(replica->getPath());
+}
+
+size_t modelManager::getFootprint(std::string model){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found == nullptr)
+        return 0;
+    size_t bytes = 0;
+    for (const std::shared_ptr<Model>& replica : *found)
+        bytes += replica->getLoadStats().memoryBytes;
+    return bytes;
+}
+
+void modelManager::setCacheDir(std::string dir){
+    if (dir.empty())
+        this->_cache.reset();
+    else
+        this->_cache = std::make_shared<ModelCache>(dir);
+}
+
+void modelManager::setMemoryMapping(bool mapped){
+    this->_mapped = mapped;
+}
+
+void modelManager::setBufferPool(std::shared_ptr<BufferPool> pool){
+    this->_pool = std::move(pool);
+}
+
+std::shared_ptr<ResultCache> modelManager::setResultCache(std::string model, size_t maxBytes){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found == nullptr)
+        throw std::runtime_error("Model not found: " + model);
+    std::shared_ptr<ResultCache> cache = maxBytes > 0 ? std::make_shared<ResultCache>(maxBytes) : nullptr;
+    for (const std::shared_ptr<Model>& replica : *found)
+        replica->setResultCache(cache);
+    return cache;
+}
+
+void modelManager::setScheduling(std::shared_ptr<const SchedulerOptions> options){
+    // Models scheduled before keep the pool they were given.
+    this->_schedulerPool = options != nullptr ? std::make_shared<SchedulerPool>(options->workers) : nullptr;
+    this->_scheduling = std::move(options);
+}
+
+std::future<std::shared_ptr<std::vector<Ort::Value>>> modelManager::runScheduled(
+    std::string model,
+    const Ort::Value& inputs,
+    const RequestOptions& request,
+    std::shared_ptr<const char*> outputHead){
+    std::shared_ptr<Model> replica = pickReplica(model);
+    if (replica == nullptr)
+        throw std::runtime_error("Model not found: " + model);
+    // Queued requests keep the replica pinned, see isPinned.
+    return replica->runScheduled(inputs, request, outputHead);
+}
+
+LoadStats modelManager::getLoadStats(std::string model){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    if (found != nullptr)
+        return found->front()->getLoadStats();
+    return LoadStats();
+}
+
+size_t modelManager::getReplicas(std::string model){
+    std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(model);
+    return found != nullptr ? found->size() : 0;
+}
+
+bool modelManager::delModel(std::string model){
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const ModelRegistry::Replicas> removed = this->_models.remove(model);
+    if (removed == nullptr){
+        std::cout << "Model not found" << std::endl;
+        return false;
+    }
+    unloaded(model, std::move(removed), start);
+    return true;
+}
+
+bool modelManager::evictModel(const std::string& model){
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const ModelRegistry::Replicas> removed = this->_models.removeIf(model, [](const std::shared_ptr<const ModelRegistry::Replicas>& replicas){
+        // A router still holding the list may be about to pick a replica.
+        if (replicas.use_count() > 1)
+            return false;
+        for (const std::shared_ptr<Model>& replica : *replicas)
+            if (replica.use_count() > 1 || replica->load() > 0 || replica->queued() > 0)
+                return false;
+        return true;
+    });
+    if (removed == nullptr)
+        return false;
+    unloaded(model, std::move(removed), start);
+    metricsFor(model)->evictions.add();
+    return true;
+}
+
+void modelManager::unloaded(const std::string& model, std::shared_ptr<const ModelRegistry::Replicas> removed, std::chrono::steady_clock::time_point start){
+    releasePrepacked(removed);
+    // Sessions are freed here unless a caller still holds a replica.
+    removed.reset();
+    std::shared_ptr<ModelMetrics> metrics = metricsFor(model);
+    metrics->unloads.add();
+    metrics->unloadTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+std::shared_ptr<ModelMetrics> modelManager::metricsFor(const std::string& model){
+    std::lock_guard<std::mutex> lock(this->_modelsMutex);
+    std::shared_ptr<ModelMetrics>& metrics = this->_metrics[model];
+    if (metrics == nullptr)
+        metrics = std::make_shared<ModelMetrics>();
+    return metrics;
+}
+
+void modelManager::attachMetrics(const std::string& model, const std::vector<std::shared_ptr<Model>>& replicas){
+    std::shared_ptr<ModelMetrics> metrics = metricsFor(model);
+    for (const std::shared_ptr<Model>& replica : replicas){
+        // Not published yet, no run can see the swap.
+        replica->_metrics = metrics;
+        metrics->loads.add();
+        metrics->loadTime.record(static_cast<uint64_t>(replica->getLoadStats().loadMs * 1e6));
+    }
+}
+
+std::vector<ModelStats> modelManager::getStats(){
+    std::vector<std::pair<std::string, std::shared_ptr<ModelMetrics>>> models;
+    {
+        std::lock_guard<std::mutex> lock(this->_modelsMutex);
+        models.assign(this->_metrics.begin(), this->_metrics.end());
+    }
+    std::vector<ModelStats> stats;
+    for (const auto& [name, metrics] : models){
+        ModelStats model;
+        model.model = name;
+        model.requests = metrics->requests.value();
+        model.failures = metrics->failures.value();
+        model.loads = metrics->loads.value();
+        model.unloads = metrics->unloads.value();
+        model.evictions = metrics->evictions.value();
+        model.expired = metrics->expired.value();
+        model.cacheHits = metrics->cacheHits.value();
+        model.cacheMisses = metrics->cacheMisses.value();
+        model.skippedFrames = metrics->skippedFrames.value();
+        model.latency = metrics->latency.snapshot();
+        model.queueWait = metrics->queueWait.snapshot();
+        model.loadTime = metrics->loadTime.snapshot();
+        model.unloadTime = metrics->unloadTime.snapshot();
+        if (std::shared_ptr<const ModelRegistry::Replicas> found = this->_models.find(name)){
+            model.replicas = found->size();
+            for (const std::shared_ptr<Model>& replica : *found)
+                model.inflight += replica->load();
+        }
+        stats.push_back(std::move(model));
+    }
+    return stats;
+}
+
+std::string modelManager::exportMetrics(){
+    return toPrometheus(getStats());
+}
+
+void modelManager::writeMetrics(const std::string& path){
+    // Unique per writer, so writers sharing the path never mix their files.
+    std::string pending = path + ".tmp." + uniqueSuffix();
+    std::error_code error;
+    {
+        std::ofstream file(pending, std::ios::trunc);
+        if (!(file << exportMetrics()) || !file.flush()){
+            file.close();
+            std::filesystem::remove(pending, error);
+            throw std::runtime_error("Cannot write " + pending);
+        }
+    }
+    std::filesystem::rename(pending, path, error);
+    if (error){
+        std::string reason = error.message();
+        std::filesystem::remove(pending, error);
+        throw std::runtime_error("Cannot replace " + path + ": " + reason);
+    }
+}
+
+void modelManager::serveMetrics(const std::string& socketPath){
+    this->_endpoint.reset();
+    this->_endpoint = std::make_unique<MetricsEndpoint>(socketPath, [this]{ return exportMetrics(); });
+}
+
+void modelManager::serveLocal(const std::string& socketPath){
+    this->_server.reset();
+    this->_server = std::make_unique<LocalServer>(*this, socketPath);
 }
\ No newline at end of file
@@ -0,0 +1,331 @@
+#include "postprocess.h"
+#include "preprocess.h"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace cinrt::model
+{
+  namespace
+  {
+    void push(Detections& detections, float x0, float y0, float x1, float y1, float score, int cls, const float* keypoints){
+      detections.x0.push_back(x0);
+      detections.y0.push_back(y0);
+      detections.x1.push_back(x1);
+      detections.y1.push_back(y1);
+      detections.score.push_back(score);
+      detections.cls.push_back(cls);
+      if (detections.numKeypoints > 0)
+        detections.keypoints.insert(detections.keypoints.end(), keypoints, keypoints + 3 * detections.numKeypoints);
+    }
+
+    Detections select(const Detections& detections, const std::vector<uint32_t>& indices){
+      Detections result;
+      result.numKeypoints = detections.numKeypoints;
+      result.reserve(indices.size());
+      const size_t stride = 3 * detections.numKeypoints;
+      for (uint32_t i : indices)
+        push(result, detections.x0[i], detections.y0[i], detections.x1[i], detections.y1[i], detections.score[i], detections.cls[i],
+          detections.keypoints.data() + i * stride);
+      return result;
+    }
+
+    void selectAboveScalar(const float* values, size_t count, float threshold, std::vector<uint32_t>& keep){
+      for (size_t i = 0; i < count; ++i)
+        if (values[i] >= threshold)
+          keep.push_back(static_cast<uint32_t>(i));
+    }
+
+#ifdef CRT_X86_SIMD
+    __attribute__((target("avx2"))) void selectAboveAVX2(const float* values, size_t count, float threshold, std::vector<uint32_t>& keep){
+      const __m256 limit = _mm256_set1_ps(threshold);
+      size_t i = 0;
+      for (; i + 8 <= count; i += 8){
+        unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), limit, _CMP_GE_OQ));
+        while (mask){
+          keep.push_back(static_cast<uint32_t>(i + __builtin_ctz(mask)));
+          mask &= mask - 1;
+        }
+      }
+      for (; i < count; ++i)
+        if (values[i] >= threshold)
+          keep.push_back(static_cast<uint32_t>(i));
+    }
+#endif
+
+    // Indices of the values at or above threshold, in order.
+    void selectAbove(const float* values, size_t count, float threshold, std::vector<uint32_t>& keep){
+      keep.clear();
+#ifdef CRT_X86_SIMD
+      if (detectSimd() >= SimdLevel::AVX2){
+        selectAboveAVX2(values, count, threshold, keep);
+        return;
+      }
+#endif
+      selectAboveScalar(values, count, threshold, keep);
+    }
+
+    // Sorted boxes in SoA form and the box currently being kept.
+    struct Overlap
+    {
+      const float* x0;
+      const float* y0;
+      const float* x1;
+      const float* y1;
+      const float* area;
+      const int* cls;
+      float bx0, by0, bx1, by1, barea;
+      int bcls;
+      float iouThreshold;
+      bool classAgnostic;
+    };
+
+    // Marks boxes [begin, count) overlapping the kept box, IoU is compared
+    // without dividing: inter > iou * union.
+    void suppressScalar(const Overlap& o, size_t begin, size_t count, uint8_t* suppressed){
+      for (size_t j = begin; j < count; ++j){
+        float w = std::max(0.f, std::min(o.bx1, o.x1[j]) - std::max(o.bx0, o.x0[j]));
+        float h = std::max(0.f, std::min(o.by1, o.y1[j]) - std::max(o.by0, o.y0[j]));
+        float inter = w * h;
+        bool overlap = inter > o.iouThreshold * (o.barea + o.area[j] - inter);
+        bool sameClass = o.classAgnostic || o.cls[j] == o.bcls;
+        suppressed[j] |= static_cast<uint8_t>(overlap & sameClass);
+      }
+    }
+
+#ifdef CRT_X86_SIMD
+    __attribute__((target("avx2"))) void suppressAVX2(const Overlap& o, size_t begin, size_t count, uint8_t* suppressed){
+      const __m256 zero = _mm256_setzero_ps();
+      const __m256 bx0 = _mm256_set1_ps(o.bx0), by0 = _mm256_set1_ps(o.by0);
+      const __m256 bx1 = _mm256_set1_ps(o.bx1), by1 = _mm256_set1_ps(o.by1);
+      const __m256 barea = _mm256_set1_ps(o.barea);
+      const __m256 iou = _mm256_set1_ps(o.iouThreshold);
+      const __m256i bcls = _mm256_set1_epi32(o.bcls);
+      size_t j = begin;
+      for (; j + 8 <= count; j += 8){
+        __m256 w = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(bx1, _mm256_loadu_ps(o.x1 + j)), _mm256_max_ps(bx0, _mm256_loadu_ps(o.x0 + j))));
+        __m256 h = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(by1, _mm256_loadu_ps(o.y1 + j)), _mm256_max_ps(by0, _mm256_loadu_ps(o.y0 + j))));
+        __m256 inter = _mm256_mul_ps(w, h);
+        __m256 uni = _mm256_sub_ps(_mm256_add_ps(barea, _mm256_loadu_ps(o.area + j)), inter);
+        __m256 hit = _mm256_cmp_ps(inter, _mm256_mul_ps(iou, uni), _CMP_GT_OQ);
+        if (!o.classAgnostic){
+          __m256i cls = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(o.cls + j));
+          hit = _mm256_and_ps(hit, _mm256_castsi256_ps(_mm256_cmpeq_epi32(cls, bcls)));
+        }
+        unsigned mask = _mm256_movemask_ps(hit);
+        while (mask){
+          suppressed[j + __builtin_ctz(mask)] = 1;
+          mask &= mask - 1;
+        }
+      }
+      suppressScalar(o, j, count, suppressed);
+    }
+#endif
+
+    // Copies a strided column into contiguous scratch for selectAbove.
+    void gather(const float* data, size_t count, size_t stride, std::vector<float>& out){
+      out.resize(count);
+      for (size_t i = 0; i < count; ++i)
+        out[i] = data[i * stride];
+    }
+
+    void finish(std::vector<Detections>& images, const PostprocessOptions& options, const std::vector<Rescale>& scales){
+      for (size_t b = 0; b < images.size(); ++b){
+        nms(images[b], options.iouThreshold, options.classAgnostic, options.maxDetections);
+        if (b < scales.size())
+          rescale(images[b], scales[b]);
+      }
+    }
+  }
+
+  void Detections::clear(){
+    x0.clear();
+    y0.clear();
+    x1.clear();
+    y1.clear();
+    score.clear();
+    cls.clear();
+    keypoints.clear();
+  }
+
+  void Detections::reserve(size_t count){
+    x0.reserve(count);
+    y0.reserve(count);
+    x1.reserve(count);
+    y1.reserve(count);
+    score.reserve(count);
+    cls.reserve(count);
+    keypoints.reserve(count * 3 * numKeypoints);
+  }
+
+  Rescale Rescale::stretch(int inputWidth, int inputHeight, int originalWidth, int originalHeight){
+    Rescale scale;
+    scale.scaleX = static_cast<float>(inputWidth) / originalWidth;
+    scale.scaleY = static_cast<float>(inputHeight) / originalHeight;
+    scale.width = static_cast<float>(originalWidth);
+    scale.height = static_cast<float>(originalHeight);
+    return scale;
+  }
+
+  Rescale Rescale::letterbox(const Letterbox& box, int originalWidth, int originalHeight){
+    Rescale scale = stretch(box.width, box.height, originalWidth, originalHeight);
+    scale.padX = static_cast<float>(box.padX);
+    scale.padY = static_cast<float>(box.padY);
+    return scale;
+  }
+
+  void nms(Detections& detections, float iouThreshold, bool classAgnostic, size_t maxDetections){
+    const size_t count = detections.size();
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){ return detections.score[a] > detections.score[b]; });
+    // Sorted and contiguous, so the overlap pass streams through memory.
+    Detections sorted = select(detections, order);
+    if (iouThreshold >= 1.f){
+      if (count > maxDetections){
+        order.resize(maxDetections);
+        std::iota(order.begin(), order.end(), 0);
+        sorted = select(sorted, order);
+      }
+      detections = std::move(sorted);
+      return;
+    }
+
+    std::vector<float> area(count);
+    for (size_t i = 0; i < count; ++i)
+      area[i] = (sorted.x1[i] - sorted.x0[i]) * (sorted.y1[i] - sorted.y0[i]);
+    Overlap overlap{sorted.x0.data(), sorted.y0.data(), sorted.x1.data(), sorted.y1.data(), area.data(), sorted.cls.data(),
+      0.f, 0.f, 0.f, 0.f, 0.f, 0, iouThreshold, classAgnostic};
+    auto suppress = suppressScalar;
+#ifdef CRT_X86_SIMD
+    if (detectSimd() >= SimdLevel::AVX2)
+      suppress = suppressAVX2;
+#endif
+    std::vector<uint8_t> suppressed(count, 0);
+    std::vector<uint32_t> keep;
+    for (size_t i = 0; i < count && keep.size() < maxDetections; ++i){
+      if (suppressed[i])
+        continue;
+      keep.push_back(static_cast<uint32_t>(i));
+      overlap.bx0 = sorted.x0[i];
+      overlap.by0 = sorted.y0[i];
+      overlap.bx1 = sorted.x1[i];
+      overlap.by1 = sorted.y1[i];
+      overlap.barea = area[i];
+      overlap.bcls = sorted.cls[i];
+      suppress(overlap, i + 1, count, suppressed.data());
+    }
+    detections = select(sorted, keep);
+  }
+
+  void rescale(Detections& detections, const Rescale& scale){
+    const float sx = 1.f / scale.scaleX;
+    const float sy = 1.f / scale.scaleY;
+    const float maxX = scale.width > 0 ? scale.width : std::numeric_limits<float>::max();
+    const float maxY = scale.height > 0 ? scale.height : std::numeric_limits<float>::max();
+    auto mapX = [&](float x){ return std::min(std::max((x - scale.padX) * sx, 0.f), maxX); };
+    auto mapY = [&](float y){ return std::min(std::max((y - scale.padY) * sy, 0.f), maxY); };
+    for (size_t i = 0; i < detections.size(); ++i){
+      detections.x0[i] = mapX(detections.x0[i]);
+      detections.y0[i] = mapY(detections.y0[i]);
+      detections.x1[i] = mapX(detections.x1[i]);
+      detections.y1[i] = mapY(detections.y1[i]);
+    }
+    for (size_t k = 0; k + 2 < detections.keypoints.size(); k += 3){
+      detections.keypoints[k] = mapX(detections.keypoints[k]);
+      detections.keypoints[k + 1] = mapY(detections.keypoints[k + 1]);
+    }
+  }
+
+  void translate(Detections& detections, float dx, float dy){
+    for (size_t i = 0; i < detections.size(); ++i){
+      detections.x0[i] += dx;
+      detections.y0[i] += dy;
+      detections.x1[i] += dx;
+      detections.y1[i] += dy;
+    }
+    for (size_t k = 0; k + 2 < detections.keypoints.size(); k += 3){
+      detections.keypoints[k] += dx;
+      detections.keypoints[k + 1] += dy;
+    }
+  }
+
+  std::vector<Detections> decodeRows(const float* data, size_t rows, size_t cols, size_t batchSize,
+    const PostprocessOptions& options, const std::vector<Rescale>& scales){
+    if (cols < 7)
+      throw std::runtime_error("Detection rows need at least 7 columns");
+    std::vector<Detections> images(batchSize);
+    for (Detections& image : images)
+      image.numKeypoints = static_cast<int>((cols - 7) / 3);
+
+    std::vector<float> scores;
+    std::vector<uint32_t> keep;
+    gather(data + 6, rows, cols, scores);
+    selectAbove(scores.data(), rows, options.scoreThreshold, keep);
+    for (uint32_t i : keep){
+      const float* row = data + i * cols;
+      size_t batch = static_cast<size_t>(row[0]);
+      if (batch >= batchSize)
+        continue;
+      push(images[batch], row[1], row[2], row[3], row[4], row[6], static_cast<int>(row[5]), row + 7);
+    }
+    finish(images, options, scales);
+    return images;
+  }
+
+  std::vector<Detections> decodeRows(const Ort::Value& output, size_t batchSize,
+    const PostprocessOptions& options, const std::vector<Rescale>& scales){
+    std::vector<int64_t> shape = output.GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.size() != 2)
+      throw std::runtime_error("Detection rows must be {N, columns}");
+    return decodeRows(output.GetTensorData<float>(), static_cast<size_t>(shape[0]), static_cast<size_t>(shape[1]), batchSize, options, scales);
+  }
+
+  std::vector<Detections> decodeHead(const float* data, size_t batchSize, size_t anchors, size_t cols,
+    const PostprocessOptions& options, const std::vector<Rescale>& scales){
+    const size_t keypointCols = 3 * static_cast<size_t>(options.numKeypoints);
+    if (cols < 6 + keypointCols)
+      throw std::runtime_error("Detection head has no class scores");
+    const size_t classes = cols - 5 - keypointCols;
+    std::vector<Detections> images(batchSize);
+    std::vector<float> scores;
+    std::vector<uint32_t> keep;
+    for (size_t b = 0; b < batchSize; ++b){
+      Detections& image = images[b];
+      image.numKeypoints = options.numKeypoints;
+      const float* head = data + b * anchors * cols;
+      // score = objectness * class score, so objectness bounds it.
+      gather(head + 4, anchors, cols, scores);
+      selectAbove(scores.data(), anchors, options.scoreThreshold, keep);
+      for (uint32_t i : keep){
+        const float* row = head + i * cols;
+        const float* classScores = row + 5;
+        size_t best = std::max_element(classScores, classScores + classes) - classScores;
+        float score = row[4] * classScores[best];
+        if (score < options.scoreThreshold)
+          continue;
+        float halfW = row[2] * 0.5f;
+        float halfH = row[3] * 0.5f;
+        push(image, row[0] - halfW, row[1] - halfH, row[0] + halfW, row[1] + halfH, score, static_cast<int>(best), classScores + classes);
+      }
+    }
+    finish(images, options, scales);
+    return images;
+  }
+
+  std::vector<Detections> decodeHead(const Ort::Value& output,
+    const PostprocessOptions& options, const std::vector<Rescale>& scales){
+    std::vector<int64_t> shape = output.GetTensorTypeAndShapeInfo().GetShape();
+    if (shape.size() == 2)
+      shape.insert(shape.begin(), 1);
+    if (shape.size() != 3)
+      throw std::runtime_error("Detection head must be {batch, anchors, columns}");
+    return decodeHead(output.GetTensorData<float>(), static_cast<size_t>(shape[0]), static_cast<size_t>(shape[1]), static_cast<size_t>(shape[2]), options, scales);
+  }
+};
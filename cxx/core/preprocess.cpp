@@ -0,0 +1,300 @@
+#include "preprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Conversions multiply then add and are never fused into an FMA, so every
+// SIMD level rounds like the scalar kernel and tensors do not depend on
+// the CPU.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace cinrt::model
+{
+  namespace
+  {
+    // Fixed-point bilinear weights, as cv::resize does for 8-bit images.
+    constexpr int BITS = 11;
+    constexpr int ONE = 1 << BITS;
+
+    // Destination plane of one source channel, value * scale + bias.
+    struct Planes
+    {
+      float* dst[3];
+      float scale[3];
+      float bias[3];
+    };
+
+    using ConvertRow = void (*)(const uint8_t* src, int width, const Planes& planes, size_t offset);
+
+    void convertScalar(const uint8_t* src, int width, const Planes& planes, size_t offset){
+      for (int x = 0; x < width; ++x)
+        for (int c = 0; c < 3; ++c)
+          planes.dst[c][offset + x] = src[3 * x + c] * planes.scale[c] + planes.bias[c];
+    }
+
+#ifdef CRT_X86_SIMD
+    // Splits 16 interleaved 3-channel pixels into one register per channel.
+    __attribute__((target("sse4.1"))) inline void deinterleave(const uint8_t* src, __m128i out[3]){
+      const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16));
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 32));
+      out[0] = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+      out[1] = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+      out[2] = _mm_or_si128(_mm_or_si128(
+        _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+        _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+        _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+    }
+
+    __attribute__((target("sse4.1"))) void convertSSE41(const uint8_t* src, int width, const Planes& planes, size_t offset){
+      int x = 0;
+      for (; x + 16 <= width; x += 16){
+        __m128i channels[3];
+        deinterleave(src + 3 * x, channels);
+        for (int c = 0; c < 3; ++c){
+          const __m128 scale = _mm_set1_ps(planes.scale[c]);
+          const __m128 bias = _mm_set1_ps(planes.bias[c]);
+          float* dst = planes.dst[c] + offset + x;
+          __m128i v = channels[c];
+          for (int i = 0; i < 4; ++i){
+            __m128 f = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(v));
+            _mm_storeu_ps(dst + 4 * i, _mm_add_ps(_mm_mul_ps(f, scale), bias));
+            v = _mm_srli_si128(v, 4);
+          }
+        }
+      }
+      convertScalar(src + 3 * x, width - x, planes, offset + x);
+    }
+
+    __attribute__((target("avx2"))) void convertAVX2(const uint8_t* src, int width, const Planes& planes, size_t offset){
+      int x = 0;
+      for (; x + 16 <= width; x += 16){
+        __m128i channels[3];
+        deinterleave(src + 3 * x, channels);
+        for (int c = 0; c < 3; ++c){
+          const __m256 scale = _mm256_set1_ps(planes.scale[c]);
+          const __m256 bias = _mm256_set1_ps(planes.bias[c]);
+          float* dst = planes.dst[c] + offset + x;
+          __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(channels[c]));
+          __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(channels[c], 8)));
+          _mm256_storeu_ps(dst, _mm256_add_ps(_mm256_mul_ps(lo, scale), bias));
+          _mm256_storeu_ps(dst + 8, _mm256_add_ps(_mm256_mul_ps(hi, scale), bias));
+        }
+      }
+      convertScalar(src + 3 * x, width - x, planes, offset + x);
+    }
+
+    __attribute__((target("avx512f"))) void convertAVX512(const uint8_t* src, int width, const Planes& planes, size_t offset){
+      int x = 0;
+      for (; x + 16 <= width; x += 16){
+        __m128i channels[3];
+        deinterleave(src + 3 * x, channels);
+        for (int c = 0; c < 3; ++c){
+          // Full-mask forms, the unmasked ones trip -Wmaybe-uninitialized in GCC.
+          __m512 f = _mm512_maskz_cvtepi32_ps(0xFFFF, _mm512_maskz_cvtepu8_epi32(0xFFFF, channels[c]));
+          __m512 scaled = _mm512_mul_ps(f, _mm512_set1_ps(planes.scale[c]));
+          _mm512_storeu_ps(planes.dst[c] + offset + x, _mm512_add_ps(scaled, _mm512_set1_ps(planes.bias[c])));
+        }
+      }
+      convertScalar(src + 3 * x, width - x, planes, offset + x);
+    }
+#endif
+
+    ConvertRow selectKernel(SimdLevel requested){
+      SimdLevel level = std::min(requested, detectSimd());
+#ifdef CRT_X86_SIMD
+      switch (level){
+        case SimdLevel::AVX512: return convertAVX512;
+        case SimdLevel::AVX2: return convertAVX2;
+        case SimdLevel::SSE41: return convertSSE41;
+        default: break;
+      }
+#endif
+      (void)level;
+      return convertScalar;
+    }
+
+    // Source taps and weight of the second tap for every output coordinate.
+    struct Axis
+    {
+      std::vector<int> first;
+      std::vector<int> second;
+      std::vector<int> weight;
+    };
+
+    Axis makeAxis(int source, int target){
+      Axis axis;
+      axis.first.resize(target);
+      axis.second.resize(target);
+      axis.weight.resize(target);
+      double scale = static_cast<double>(source) / target;
+      for (int i = 0; i < target; ++i){
+        double f = (i + 0.5) * scale - 0.5;
+        int s = static_cast<int>(std::floor(f));
+        f -= s;
+        if (s < 0){
+          s = 0;
+          f = 0;
+        }
+        if (s >= source - 1){
+          s = source - 1;
+          f = 0;
+        }
+        axis.first[i] = s;
+        axis.second[i] = std::min(s + 1, source - 1);
+        axis.weight[i] = static_cast<int>(std::lround(f * ONE));
+      }
+      return axis;
+    }
+
+    void horizontal(const uint8_t* src, const Axis& axis, int32_t* out){
+      for (size_t x = 0; x < axis.first.size(); ++x){
+        const uint8_t* p0 = src + 3 * axis.first[x];
+        const uint8_t* p1 = src + 3 * axis.second[x];
+        int w = axis.weight[x];
+        for (int c = 0; c < 3; ++c)
+          out[3 * x + c] = p0[c] * (ONE - w) + p1[c] * w;
+      }
+    }
+
+    // Plain loop so the compiler vectorizes the blend of the two rows.
+    void vertical(const int32_t* row0, const int32_t* row1, int weight, size_t count, uint8_t* out){
+      const int32_t w0 = ONE - weight;
+      const int32_t round = 1 << (2 * BITS - 1);
+      for (size_t i = 0; i < count; ++i)
+        out[i] = static_cast<uint8_t>((row0[i] * w0 + row1[i] * weight + round) >> (2 * BITS));
+    }
+  }
+
+  SimdLevel detectSimd(){
+#ifdef CRT_X86_SIMD
+    static const SimdLevel level = [](){
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::AVX512;
+      if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::AVX2;
+      if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::SSE41;
+      return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+  }
+
+  namespace
+  {
+    Planes makePlanes(float* dst, size_t planeSize, const PreprocessOptions& options){
+      Planes planes;
+      for (int c = 0; c < 3; ++c){
+        int channel = options.swapRB ? 2 - c : c;
+        planes.dst[c] = dst + channel * planeSize;
+        planes.scale[c] = 1.f / (255.f * options.std[channel]);
+        planes.bias[c] = -options.mean[channel] / options.std[channel];
+      }
+      return planes;
+    }
+
+    // Resizes src to width x height into the planes, whose rows are
+    // rowStride floats apart, starting at column x0 of row y0.
+    void resizeInto(const ImageView& src, const Planes& planes, int width, int height, size_t rowStride, int x0, int y0, SimdLevel simd){
+      const size_t stride = src.stride ? src.stride : static_cast<size_t>(src.width) * 3;
+      ConvertRow convert = selectKernel(simd);
+      auto offset = [&](int y){ return static_cast<size_t>(y + y0) * rowStride + x0; };
+
+      if (src.width == width && src.height == height){
+        for (int y = 0; y < height; ++y)
+          convert(src.data + y * stride, width, planes, offset(y));
+        return;
+      }
+
+      // Resized rows are produced one at a time into buffers that stay in
+      // cache, horizontal passes are reused while the source rows repeat.
+      Axis xs = makeAxis(src.width, width);
+      Axis ys = makeAxis(src.height, height);
+      const size_t count = static_cast<size_t>(width) * 3;
+      std::vector<int32_t> rows[2] = {std::vector<int32_t>(count), std::vector<int32_t>(count)};
+      int tags[2] = {-1, -1};
+      std::vector<uint8_t> resized(count);
+      for (int y = 0; y < height; ++y){
+        if (tags[0] != ys.first[y] && tags[1] == ys.first[y]){
+          std::swap(rows[0], rows[1]);
+          std::swap(tags[0], tags[1]);
+        }
+        if (tags[0] != ys.first[y]){
+          horizontal(src.data + ys.first[y] * stride, xs, rows[0].data());
+          tags[0] = ys.first[y];
+        }
+        if (tags[1] != ys.second[y]){
+          horizontal(src.data + ys.second[y] * stride, xs, rows[1].data());
+          tags[1] = ys.second[y];
+        }
+        vertical(rows[0].data(), rows[1].data(), ys.weight[y], count, resized.data());
+        convert(resized.data(), width, planes, offset(y));
+      }
+    }
+  }
+
+  void imageToTensor(const ImageView& src, float* dst, int width, int height, const PreprocessOptions& options){
+    if (src.data == nullptr || src.width <= 0 || src.height <= 0 || width <= 0 || height <= 0)
+      throw std::runtime_error("Invalid image or tensor size");
+    Planes planes = makePlanes(dst, static_cast<size_t>(width) * height, options);
+    resizeInto(src, planes, width, height, width, 0, 0, options.simd);
+  }
+
+  Letterbox Letterbox::fit(int imageWidth, int imageHeight, int width, int height, bool upscale){
+    Letterbox box;
+    box.scale = std::min(static_cast<float>(width) / imageWidth, static_cast<float>(height) / imageHeight);
+    if (!upscale)
+      box.scale = std::min(box.scale, 1.f);
+    box.width = std::clamp(static_cast<int>(std::lround(imageWidth * box.scale)), 1, width);
+    box.height = std::clamp(static_cast<int>(std::lround(imageHeight * box.scale)), 1, height);
+    box.padX = (width - box.width) / 2;
+    box.padY = (height - box.height) / 2;
+    return box;
+  }
+
+  void letterboxToTensor(const ImageView& src, float* dst, int width, int height, const Letterbox& box, const PreprocessOptions& options, uint8_t padValue){
+    if (src.data == nullptr || src.width <= 0 || src.height <= 0 || width <= 0 || height <= 0)
+      throw std::runtime_error("Invalid image or tensor size");
+    if (box.width <= 0 || box.height <= 0 || box.padX < 0 || box.padY < 0 || box.padX + box.width > width || box.padY + box.height > height)
+      throw std::runtime_error("Letterbox does not fit the tensor");
+    Planes planes = makePlanes(dst, static_cast<size_t>(width) * height, options);
+    // Only the border is filled, the image rows are written once.
+    for (int c = 0; c < 3; ++c){
+      const float pad = padValue * planes.scale[c] + planes.bias[c];
+      float* plane = planes.dst[c];
+      std::fill(plane, plane + static_cast<size_t>(box.padY) * width, pad);
+      for (int y = box.padY; y < box.padY + box.height; ++y){
+        float* row = plane + static_cast<size_t>(y) * width;
+        std::fill(row, row + box.padX, pad);
+        std::fill(row + box.padX + box.width, row + width, pad);
+      }
+      std::fill(plane + static_cast<size_t>(box.padY + box.height) * width, plane + static_cast<size_t>(height) * width, pad);
+    }
+    resizeInto(src, planes, box.width, box.height, width, box.padX, box.padY, options.simd);
+  }
+
+  void imagesToTensor(const std::vector<ImageView>& images, float* dst, int width, int height, const PreprocessOptions& options){
+    const size_t imageSize = static_cast<size_t>(width) * height * 3;
+    for (size_t i = 0; i < images.size(); ++i)
+      imageToTensor(images[i], dst + i * imageSize, width, height, options);
+  }
+};
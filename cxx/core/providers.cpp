@@ -0,0 +1,126 @@
+#include "providers.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace cinrt::model
+{
+  namespace
+  {
+    bool isAvailable(const std::vector<std::string>& available, const std::string& name){
+      return std::find(available.begin(), available.end(), name) != available.end();
+    }
+
+    void appendDnnl(Ort::SessionOptions& options, const std::map<std::string, std::string>& settings){
+      const OrtApi& api = Ort::GetApi();
+      OrtDnnlProviderOptions* dnnl = nullptr;
+      Ort::ThrowOnError(api.CreateDnnlProviderOptions(&dnnl));
+      std::unique_ptr<OrtDnnlProviderOptions, void(*)(OrtDnnlProviderOptions*)> guard(dnnl, api.ReleaseDnnlProviderOptions);
+      std::vector<const char*> keys;
+      std::vector<const char*> values;
+      for (const auto& [key, value] : settings){
+        keys.push_back(key.c_str());
+        values.push_back(value.c_str());
+      }
+      if (!keys.empty())
+        Ort::ThrowOnError(api.UpdateDnnlProviderOptions(dnnl, keys.data(), values.data(), keys.size()));
+      Ort::ThrowOnError(api.SessionOptionsAppendExecutionProvider_Dnnl(options, dnnl));
+    }
+
+    // Value of a string field of a trace event, the trace keeps one event per line.
+    std::string field(const std::string& line, const std::string& key){
+      size_t at = line.find("\"" + key + "\"");
+      if (at == std::string::npos)
+        return "";
+      size_t colon = line.find(':', at + key.size() + 2);
+      size_t open = colon == std::string::npos ? colon : line.find('"', colon);
+      size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+      if (close == std::string::npos)
+        return "";
+      return line.substr(open + 1, close - open - 1);
+    }
+  }
+
+  std::string providerName(const std::string& name){
+    static const std::map<std::string, std::string> names = {
+      {"CPU", "CPUExecutionProvider"},
+      {"CPUExecutionProvider", "CPUExecutionProvider"},
+      {"XNNPACK", "XnnpackExecutionProvider"},
+      {"XnnpackExecutionProvider", "XnnpackExecutionProvider"},
+      {"DNNL", "DnnlExecutionProvider"},
+      {"oneDNN", "DnnlExecutionProvider"},
+      {"DnnlExecutionProvider", "DnnlExecutionProvider"},
+    };
+    auto it = names.find(name);
+    return it != names.end() ? it->second : "";
+  }
+
+  std::vector<std::string> availableProviders(){
+    return Ort::GetAvailableProviders();
+  }
+
+  std::vector<std::string> appendProviders(Ort::SessionOptions& options, const std::vector<ExecutionProvider>& providers){
+    std::vector<std::string> applied;
+    if (providers.empty()){
+      applied.push_back("CPUExecutionProvider");
+      return applied;
+    }
+    std::vector<std::string> available = availableProviders();
+    for (const ExecutionProvider& provider : providers){
+      std::string name = providerName(provider.name);
+      if (name.empty()){
+        std::cout << "Skipping unsupported execution provider " << provider.name << std::endl;
+        continue;
+      }
+      // Always registered last by ORT, listing it ends the preferences.
+      if (name == "CPUExecutionProvider")
+        break;
+      if (!isAvailable(available, name)){
+        std::cout << "Skipping execution provider " << name << ", not in this ORT build" << std::endl;
+        continue;
+      }
+      if (isAvailable(applied, name))
+        continue;
+      try {
+        if (name == "XnnpackExecutionProvider")
+          options.AppendExecutionProvider("XNNPACK", std::unordered_map<std::string, std::string>(provider.options.begin(), provider.options.end()));
+        else
+          appendDnnl(options, provider.options);
+        applied.push_back(name);
+      }
+      catch (Ort::Exception& exception) {
+        // Shared provider libraries are loaded here, a missing one lands the
+        // nodes on the next provider.
+        std::cout << "Skipping execution provider " << name << ": " << exception.what() << std::endl;
+      }
+    }
+    applied.push_back("CPUExecutionProvider");
+    return applied;
+  }
+
+  std::vector<NodePlacement> readPlacement(const std::string& trace){
+    std::ifstream file(trace);
+    if (!file)
+      throw std::runtime_error("Cannot read profile " + trace);
+    const std::string suffix = "_kernel_time";
+    std::vector<NodePlacement> placement;
+    std::set<std::string> seen;
+    std::string line;
+    while (std::getline(file, line)){
+      if (field(line, "cat") != "Node")
+        continue;
+      std::string name = field(line, "name");
+      if (name.size() <= suffix.size() || name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        continue;
+      name.resize(name.size() - suffix.size());
+      if (!seen.insert(name).second)
+        continue;
+      placement.push_back({name, field(line, "op_name"), field(line, "provider")});
+    }
+    return placement;
+  }
+};
@@ -0,0 +1,115 @@
+#include "registry.h"
+#include <thread>
+
+using namespace cinrt::model;
+
+namespace
+{
+  size_t readerStripe(){
+    static std::atomic<size_t> next{0};
+    thread_local size_t stripe = next.fetch_add(1, std::memory_order_relaxed);
+    return stripe;
+  }
+
+  struct ReadGuard
+  {
+    std::atomic<int64_t>& counter;
+    ~ReadGuard() { counter.fetch_sub(1, std::memory_order_release); }
+  };
+}
+
+ModelRegistry::ModelRegistry() : _current(new Snapshot()) {}
+
+ModelRegistry::~ModelRegistry(){
+  delete _current.load();
+}
+
+std::atomic<int64_t>& ModelRegistry::enter() const {
+  size_t stripe = readerStripe() % STRIPES;
+  while (true){
+    uint64_t epoch = _epoch.load();
+    std::atomic<int64_t>& counter = _readers[epoch & 1][stripe].value;
+    counter.fetch_add(1);
+    // Counted under an epoch the writer has not flipped away from yet.
+    if (_epoch.load() == epoch)
+      return counter;
+    counter.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void ModelRegistry::synchronize(){
+  uint64_t epoch = _epoch.load();
+  _epoch.store(epoch + 1);
+  for (ReaderCount& reader : _readers[epoch & 1])
+    while (reader.value.load() != 0)
+      std::this_thread::yield();
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::find(const std::string& name) const {
+  ReadGuard guard{enter()};
+  const Snapshot* snapshot = _current.load();
+  auto it = snapshot->find(name);
+  return it != snapshot->end() ? it->second : nullptr;
+}
+
+std::vector<std::string> ModelRegistry::names() const {
+  ReadGuard guard{enter()};
+  const Snapshot* snapshot = _current.load();
+  std::vector<std::string> result;
+  result.reserve(snapshot->size());
+  for (const auto& entry : *snapshot)
+    result.push_back(entry.first);
+  return result;
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::replace(const std::string& name, std::shared_ptr<const Replicas> replicas){
+  std::lock_guard<std::mutex> lock(_writer);
+  return replaceLocked(name, std::move(replicas));
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::replaceLocked(const std::string& name, std::shared_ptr<const Replicas> replicas){
+  const Snapshot* current = _current.load();
+  Snapshot* next = new Snapshot(*current);
+  std::shared_ptr<const Replicas> previous;
+  auto it = next->find(name);
+  if (it != next->end()){
+    previous = it->second;
+    if (replicas != nullptr)
+      it->second = std::move(replicas);
+    else
+      next->erase(it);
+  } else if (replicas != nullptr){
+    next->emplace(name, std::move(replicas));
+  }
+  _current.store(next);
+  synchronize();
+  delete current;
+  return previous;
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::publish(const std::string& name, Replicas replicas){
+  return replace(name, std::make_shared<const Replicas>(std::move(replicas)));
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::remove(const std::string& name){
+  return replace(name, nullptr);
+}
+
+std::shared_ptr<const ModelRegistry::Replicas> ModelRegistry::removeIf(
+  const std::string& name, const std::function<bool(const std::shared_ptr<const Replicas>&)>& evictable){
+  std::lock_guard<std::mutex> lock(_writer);
+  // After the grace period, only readers that already copied the list or
+  // a replica still reach them, and evictable sees their references.
+  std::shared_ptr<const Replicas> removed = replaceLocked(name, nullptr);
+  if (removed == nullptr || evictable(removed))
+    return removed;
+  replaceLocked(name, std::move(removed));
+  return nullptr;
+}
+
+void ModelRegistry::clear(){
+  std::lock_guard<std::mutex> lock(_writer);
+  const Snapshot* current = _current.exchange(new Snapshot());
+  synchronize();
+  delete current;
+}
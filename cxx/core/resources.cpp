@@ -0,0 +1,32 @@
+#include "resources.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace cinrt::model
+{
+  size_t residentBytes(){
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident)
+      return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+  }
+
+  std::string uniqueSuffix(){
+    static std::atomic<uint64_t> next{0};
+#ifdef _WIN32
+    long pid = ::_getpid();
+#else
+    long pid = ::getpid();
+#endif
+    return std::to_string(pid) + "." + std::to_string(next.fetch_add(1, std::memory_order_relaxed));
+  }
+};
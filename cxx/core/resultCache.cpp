@@ -0,0 +1,133 @@
+#include "resultCache.h"
+#include "hash.h"
+#include "tensor.h"
+#include <cstring>
+
+using namespace cinrt::model;
+
+namespace
+{
+  // Seed of ResultKey::check, unrelated to the seed of ResultKey::hash.
+  constexpr uint64_t CHECK_SEED = 0x9e3779b97f4a7c15ull;
+
+  template <typename T>
+  void append(std::string& layout, const T& value){
+    layout.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+}
+
+ResultCache::ResultCache(size_t maxBytes) : _maxBytes(maxBytes) {}
+
+bool ResultCache::key(
+  const char* const* inputNames,
+  const Ort::Value* inputs,
+  size_t inputCount,
+  const char* const* outputNames,
+  size_t outputCount,
+  ResultKey& key){
+  key = ResultKey();
+  key.check = CHECK_SEED;
+  // Names keep their terminator, so "ab" + "c" differs from "a" + "bc".
+  for (size_t i = 0; i < inputCount; ++i){
+    if (!inputs[i].IsTensor())
+      return false;
+    auto info = inputs[i].GetTensorTypeAndShapeInfo();
+    ONNXTensorElementDataType type = info.GetElementType();
+    if (elementSize(type) == 0)
+      return false;
+    std::vector<int64_t> shape = info.GetShape();
+    key.layout.append(inputNames[i], std::strlen(inputNames[i]) + 1);
+    append(key.layout, type);
+    append(key.layout, shape.size());
+    for (int64_t dim : shape)
+      append(key.layout, dim);
+    const void* data = inputs[i].GetTensorRawData();
+    size_t bytes = tensorBytes(inputs[i]);
+    key.hash = hash64(data, bytes, key.hash);
+    key.check = hash64(data, bytes, key.check);
+  }
+  append(key.layout, outputCount);
+  for (size_t i = 0; i < outputCount; ++i)
+    key.layout.append(outputNames[i], std::strlen(outputNames[i]) + 1);
+  key.hash = hash64(key.layout.data(), key.layout.size(), key.hash);
+  return true;
+}
+
+std::shared_ptr<std::vector<Ort::Value>> ResultCache::find(const ResultKey& key){
+  std::shared_ptr<const std::vector<Ort::Value>> cached;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key.hash);
+    if (it != _index.end() && it->second->key == key){
+      _entries.splice(_entries.begin(), _entries, it->second);
+      cached = it->second->outputs;
+    }
+  }
+  if (cached == nullptr){
+    _misses.add();
+    return nullptr;
+  }
+  _hits.add();
+  // Copied outside the lock, the entry stays alive through cached.
+  auto outputs = std::make_shared<std::vector<Ort::Value>>();
+  outputs->reserve(cached->size());
+  for (const Ort::Value& value : *cached)
+    outputs->push_back(cloneTensor(value, _allocator));
+  return outputs;
+}
+
+void ResultCache::insert(const ResultKey& key, const std::vector<Ort::Value>& outputs){
+  size_t bytes = 0;
+  for (const Ort::Value& value : outputs){
+    if (!value.IsTensor() || elementSize(value.GetTensorTypeAndShapeInfo().GetElementType()) == 0)
+      return;
+    bytes += tensorBytes(value);
+  }
+  if (bytes > _maxBytes)
+    return;
+  auto copy = std::make_shared<std::vector<Ort::Value>>();
+  copy->reserve(outputs.size());
+  for (const Ort::Value& value : outputs)
+    copy->push_back(cloneTensor(value, _allocator));
+  // Evicted results are released outside the lock.
+  std::vector<std::shared_ptr<const std::vector<Ort::Value>>> evicted;
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto it = _index.find(key.hash);
+  if (it != _index.end()){
+    // Concurrent misses on the same input, or a hash collision: keep the
+    // first result.
+    if (it->second->key == key)
+      _entries.splice(_entries.begin(), _entries, it->second);
+    return;
+  }
+  while (!_entries.empty() && _bytes + bytes > _maxBytes){
+    Entry& last = _entries.back();
+    _bytes -= last.bytes;
+    _index.erase(last.key.hash);
+    evicted.push_back(std::move(last.outputs));
+    _entries.pop_back();
+    _evictions.add();
+  }
+  _entries.push_front({key, std::move(copy), bytes});
+  _index[key.hash] = _entries.begin();
+  _bytes += bytes;
+}
+
+void ResultCache::clear(){
+  std::list<Entry> entries;
+  std::lock_guard<std::mutex> lock(_mutex);
+  entries.swap(_entries);
+  _index.clear();
+  _bytes = 0;
+}
+
+ResultCacheStats ResultCache::getStats() const {
+  ResultCacheStats stats;
+  stats.hits = _hits.value();
+  stats.misses = _misses.value();
+  stats.evictions = _evictions.value();
+  std::lock_guard<std::mutex> lock(_mutex);
+  stats.entries = _entries.size();
+  stats.bytes = _bytes;
+  return stats;
+}
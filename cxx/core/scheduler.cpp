@@ -0,0 +1,294 @@
+#include "scheduler.h"
+#include "core.h"
+#include "tensor.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace cinrt::model;
+
+SchedulerPool::SchedulerPool(size_t workers) {
+  if (workers == 0)
+    workers = 1;
+  // A single worker has no spare one, batch tasks still get it.
+  _batchSlots = workers > 1 ? workers - 1 : 1;
+  for (size_t i = 0; i < workers; ++i)
+    _workers.emplace_back(&SchedulerPool::work, this);
+  _watchdog = std::thread(&SchedulerPool::watch, this);
+}
+
+SchedulerPool::~SchedulerPool(){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _ready.notify_all();
+  _watch.notify_all();
+  for (std::thread& worker : _workers)
+    if (worker.joinable())
+      worker.join();
+  if (_watchdog.joinable())
+    _watchdog.join();
+}
+
+void SchedulerPool::post(Priority priority, std::function<void()> task){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stop)
+      return;
+    _tasks[static_cast<int>(priority)].push_back(std::move(task));
+  }
+  _ready.notify_one();
+}
+
+void SchedulerPool::at(std::chrono::steady_clock::time_point time, std::function<void()> fire){
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stop)
+      return;
+    _timers.push({time, std::move(fire)});
+  }
+  _watch.notify_one();
+}
+
+void SchedulerPool::work(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true){
+    _ready.wait(lock, [this]{ return _stop || !_tasks[0].empty() || (!_tasks[1].empty() && _runningBatch < _batchSlots); });
+    if (_stop)
+      return;
+    const bool batch = _tasks[0].empty();
+    std::deque<std::function<void()>>& tasks = _tasks[batch ? 1 : 0];
+    std::function<void()> task = std::move(tasks.front());
+    tasks.pop_front();
+    if (batch)
+      ++_runningBatch;
+    lock.unlock();
+    task();
+    task = nullptr;
+    lock.lock();
+    if (batch){
+      --_runningBatch;
+      _ready.notify_one();
+    }
+  }
+}
+
+void SchedulerPool::watch(){
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stop){
+    if (_timers.empty()){
+      _watch.wait(lock);
+      continue;
+    }
+    const auto due = _timers.top().at;
+    if (due > std::chrono::steady_clock::now()){
+      _watch.wait_until(lock, due);
+      continue;
+    }
+    std::function<void()> fire = _timers.top().fire;
+    _timers.pop();
+    lock.unlock();
+    fire();
+    fire = nullptr;
+    lock.lock();
+  }
+}
+
+Scheduler::Scheduler(Model* model, const SchedulerOptions& options, std::shared_ptr<SchedulerPool> pool)
+  : _pool(std::move(pool)), _state(std::make_shared<State>()) {
+  State& state = *_state;
+  state.model = model;
+  state.options = options;
+  if (state.options.workers == 0)
+    state.options.workers = 1;
+  if (state.options.workers > 1)
+    state.options.batchSlots = std::min(state.options.batchSlots, state.options.workers - 1);
+  // A single worker has no spare one, batch requests still get it.
+  state.options.batchSlots = std::max<size_t>(state.options.batchSlots, 1);
+  if (_pool == nullptr)
+    _pool = std::make_shared<SchedulerPool>(state.options.workers);
+}
+
+Scheduler::~Scheduler(){
+  State& state = *_state;
+  std::vector<std::unique_ptr<Request>> queued;
+  {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.stop = true;
+    for (Queue& queue : state.queues){
+      for (auto& entry : queue){
+        state.model->_queued.fetch_sub(1, std::memory_order_relaxed);
+        queued.push_back(std::move(entry.second));
+      }
+      queue.clear();
+    }
+    // Tasks left in the pool see stop and return without the model.
+    state.idle.wait(lock, [&state]{ return state.active == 0; });
+  }
+  for (std::unique_ptr<Request>& request : queued)
+    request->promise.set_exception(std::make_exception_ptr(std::runtime_error("Scheduler is stopped")));
+}
+
+std::future<std::shared_ptr<std::vector<Ort::Value>>> Scheduler::submit(
+  const Ort::Value& inputs,
+  const RequestOptions& request,
+  std::shared_ptr<const char*> outputHead,
+  Ort::RunOptions runOptions){
+  State& state = *_state;
+  auto pending = std::make_unique<Request>();
+  pending->options = request;
+  pending->outputHead = std::move(outputHead);
+  pending->runOptions = std::move(runOptions);
+  pending->submitted = std::chrono::steady_clock::now();
+  std::future<std::shared_ptr<std::vector<Ort::Value>>> result = pending->promise.get_future();
+  if (request.deadline <= pending->submitted){
+    expire(state, std::move(pending), "Deadline expired before the request was queued");
+    return result;
+  }
+  std::shared_ptr<BufferPool> buffers = std::atomic_load(&state.model->_pool);
+  if (buffers != nullptr)
+    pending->input = buffers->clone(inputs);
+  else
+    pending->input.value = cloneTensor(inputs, _allocator);
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.stop)
+      throw std::runtime_error("Scheduler is stopped");
+    if (state.queues[0].size() + state.queues[1].size() >= state.options.capacity)
+      throw std::runtime_error("Scheduler queue is full");
+    state.model->_queued.fetch_add(1, std::memory_order_relaxed);
+    state.queues[static_cast<int>(request.priority)].emplace(request.deadline, std::move(pending));
+  }
+  post(_state, *_pool, request.priority);
+  if (request.deadline != std::chrono::steady_clock::time_point::max()){
+    std::weak_ptr<State> weak = _state;
+    _pool->at(request.deadline, [weak]{
+      if (std::shared_ptr<State> state = weak.lock())
+        watch(*state);
+    });
+  }
+  return result;
+}
+
+size_t Scheduler::pending(){
+  std::lock_guard<std::mutex> lock(_state->mutex);
+  return _state->queues[0].size() + _state->queues[1].size();
+}
+
+void Scheduler::post(const std::shared_ptr<State>& state, SchedulerPool& pool, Priority priority){
+  // Tasks run on the pool itself, so it outlives them.
+  SchedulerPool* runner = &pool;
+  pool.post(priority, [state, runner, priority]{ runNext(state, *runner, priority); });
+}
+
+void Scheduler::expire(State& state, std::unique_ptr<Request> request, const char* reason){
+  state.model->_metrics->expired.add();
+  request->promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+}
+
+void Scheduler::runNext(const std::shared_ptr<State>& shared, SchedulerPool& pool, Priority priority){
+  State& state = *shared;
+  const bool batch = priority == Priority::Batch;
+  std::unique_lock<std::mutex> lock(state.mutex);
+  Queue& queue = state.queues[static_cast<int>(priority)];
+  // The request of this task may have expired, its task is then spare.
+  if (state.stop || queue.empty())
+    return;
+  if (state.active >= state.options.workers || (batch && state.runningBatch >= state.options.batchSlots)){
+    ++state.deferred[static_cast<int>(priority)];
+    return;
+  }
+  std::unique_ptr<Request> request = std::move(queue.begin()->second);
+  queue.erase(queue.begin());
+  state.model->_queued.fetch_sub(1, std::memory_order_relaxed);
+  // Counted from here on, ~Scheduler waits before the model goes away.
+  ++state.active;
+  auto now = std::chrono::steady_clock::now();
+  const bool expired = request->options.deadline <= now;
+  if (!expired){
+    if (batch)
+      ++state.runningBatch;
+    state.running.insert(request.get());
+  }
+  lock.unlock();
+
+  if (expired){
+    expire(state, std::move(request), "Deadline expired while queued");
+  } else {
+    state.model->_metrics->queueWait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request->submitted).count());
+    std::shared_ptr<std::vector<Ort::Value>> outputs;
+    std::exception_ptr error;
+    try {
+      outputs = state.model->run(request->input.value, request->outputHead, request->runOptions);
+    }
+    catch (...) {
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    state.running.erase(request.get());
+    bool terminated = request->terminated;
+    lock.unlock();
+    if (error)
+      request->promise.set_exception(error);
+    else if (outputs != nullptr)
+      request->promise.set_value(std::move(outputs));
+    else if (terminated)
+      expire(state, std::move(request), "Deadline expired during the run");
+    else
+      request->promise.set_exception(std::make_exception_ptr(std::runtime_error("Inference failed")));
+    // Inputs go back to the pool outside the lock.
+    request.reset();
+  }
+
+  lock.lock();
+  if (!expired && batch)
+    --state.runningBatch;
+  --state.active;
+  // A slot is free, deferred tasks try again and defer anew if still blocked.
+  size_t deferred[2] = {state.deferred[0], state.deferred[1]};
+  state.deferred[0] = state.deferred[1] = 0;
+  const bool stop = state.stop;
+  if (state.active == 0)
+    state.idle.notify_all();
+  lock.unlock();
+  if (stop)
+    return;
+  for (int p = 0; p < 2; ++p)
+    for (size_t i = 0; i < deferred[p]; ++i)
+      post(shared, pool, static_cast<Priority>(p));
+}
+
+void Scheduler::watch(State& state){
+  std::unique_lock<std::mutex> lock(state.mutex);
+  if (state.stop)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  std::vector<std::unique_ptr<Request>> expired;
+  for (Queue& queue : state.queues){
+    // Ordered by deadline, expired requests are at the front.
+    while (!queue.empty() && queue.begin()->first <= now){
+      expired.push_back(std::move(queue.begin()->second));
+      queue.erase(queue.begin());
+      state.model->_queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  for (Request* request : state.running){
+    if (!request->terminated && request->options.deadline <= now){
+      // The run fails at the next node ORT executes.
+      request->runOptions.SetTerminate();
+      request->terminated = true;
+    }
+  }
+  if (expired.empty())
+    return;
+  // Their tasks find nothing left to run and return.
+  ++state.active;
+  lock.unlock();
+  for (std::unique_ptr<Request>& request : expired)
+    expire(state, std::move(request), "Deadline expired while queued");
+  expired.clear();
+  lock.lock();
+  if (--state.active == 0)
+    state.idle.notify_all();
+}
@@ -2,21 +2,42 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 serviceManager::serviceManager(std::shared_ptr<Ort::Env> env) : modelManager(env){
     startGC();
 }
 
+serviceManager::serviceManager(const ThreadPoolOptions& threadPool) : modelManager(threadPool){
+    startGC();
+}
+
 serviceManager::~serviceManager(){
     stopGC();
     if (gc.joinable()){
         gc.join();
     }
+    // Pending loads call back into this object.
+    _loader.reset();
+}
+
+void serviceManager::onModelLoaded(const std::string& model){
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        sessionClock[model].loaded = std::chrono::steady_clock::now();
+    }
+    // A new model may push the footprint over budget.
+    gcWake.notify_one();
 }
 
 void serviceManager::updateSessionClock(std::string model){
-    std::lock_guard<std::mutex> lock(clockMutex);
-    sessionClock[model] = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        if (sessionClock.find(model) == sessionClock.end())
+            sessionClock.emplace(model, SessionUsage{std::chrono::steady_clock::now()});
+    }
+    // Routing a request records the use on the picked replica.
+    acquireModel(model);
     // std::cout << "Updated session clock for model: " << model << std::endl;
 }
 
@@ -25,7 +46,7 @@ float serviceManager::getSessionClock(std::string model){
     // auto currentTime = std::chrono::steady_clock::now();
     auto it = sessionClock.find(model);
     if (it != sessionClock.end()) {
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - it->second).count();
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - getUsage(model).lastUsed).count();
         // std::cout << "Session duration for model " << model << ": " << duration << " seconds" << std::endl;  // Debugging statement
         return duration;
     }
@@ -33,33 +54,129 @@ float serviceManager::getSessionClock(std::string model){
     return 0.0f;
 }
 
+void serviceManager::setMemoryBudget(size_t bytes){
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        memoryBudget = bytes;
+    }
+    gcWake.notify_one();
+}
+
+void serviceManager::setIdleTimeout(std::chrono::milliseconds timeout){
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        idleTimeout = timeout;
+    }
+    gcWake.notify_one();
+}
+
+void serviceManager::setEvictionPolicy(EvictionPolicy policy){
+    std::lock_guard<std::mutex> lock(clockMutex);
+    evictionPolicy = policy;
+}
+
+std::vector<std::string> serviceManager::evictionOrder(std::chrono::steady_clock::time_point now){
+    struct Candidate
+    {
+        std::string model;
+        double score;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto& entry : sessionClock){
+        Usage usage = getUsage(entry.first);
+        double score;
+        if (evictionPolicy == EvictionPolicy::LRU){
+            score = std::chrono::duration<double>(usage.lastUsed.time_since_epoch()).count();
+        } else {
+            // Expected reload cost per second if the model were evicted.
+            double lifetime = std::max(1.0, std::chrono::duration<double>(now - entry.second.loaded).count());
+            double reloadMs = std::max(1.0, getLoadStats(entry.first).loadMs);
+            score = reloadMs * usage.uses / lifetime;
+        }
+        candidates.push_back({entry.first, score});
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b){ return a.score < b.score; });
+    std::vector<std::string> order;
+    for (Candidate& candidate : candidates)
+        order.push_back(std::move(candidate.model));
+    return order;
+}
+
 void serviceManager::garbageCollector(){
+    std::unique_lock<std::mutex> lock(clockMutex);
     while (!stopGCFlag)
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Run every 5ms
-        std::lock_guard<std::mutex> lock(clockMutex);
-        auto currentTime = std::chrono::steady_clock::now();
+        auto now = std::chrono::steady_clock::now();
+        // Forget models deleted behind our back.
         for (auto it = sessionClock.begin(); it != sessionClock.end();){
-            if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - it->second).count() > 500){
-                delModel(it->first);
+            if (getReplicas(it->first) == 0)
                 it = sessionClock.erase(it);
-            } else {
+            else
                 ++it;
+        }
+        size_t total = 0;
+        for (const auto& entry : sessionClock)
+            total += getFootprint(entry.first);
+        bool blocked = false;
+        for (const std::string& model : evictionOrder(now)){
+            auto it = sessionClock.find(model);
+            if (it == sessionClock.end())
+                continue;
+            bool idle = idleTimeout.count() > 0 && now - getUsage(model).lastUsed > idleTimeout;
+            bool overBudget = memoryBudget > 0 && total > memoryBudget;
+            if (!idle && !overBudget)
+                continue;
+            // In-flight runs and held handles keep a model resident. Checked
+            // first without a writer step, evictModel checks again atomically.
+            if (isPinned(model)){
+                blocked = blocked || overBudget;
+                continue;
+            }
+            size_t footprint = getFootprint(model);
+            SessionUsage usage = it->second;
+            sessionClock.erase(it);
+            lock.unlock();
+            bool evicted = evictModel(model);
+            lock.lock();
+            if (!evicted){
+                // Pinned meanwhile, or deleted by another caller.
+                if (getReplicas(model) > 0)
+                    sessionClock.emplace(model, usage);
+                blocked = blocked || overBudget;
+                continue;
             }
+            total -= std::min(total, footprint);
         }
+        // Sleep until the next model goes idle, or until a load, a config
+        // change or stopGC. Pinned models over budget are retried shortly.
+        auto wake = std::chrono::steady_clock::time_point::max();
+        if (idleTimeout.count() > 0)
+            for (const auto& entry : sessionClock)
+                wake = std::min(wake, getUsage(entry.first).lastUsed + idleTimeout + std::chrono::milliseconds(1));
+        if (blocked)
+            wake = std::min(wake, now + std::chrono::milliseconds(50));
+        if (wake == std::chrono::steady_clock::time_point::max())
+            gcWake.wait(lock);
+        else
+            gcWake.wait_until(lock, wake);
     }
-    
-    
 }
 
 void serviceManager::startGC(){
     if (gc.joinable()){
         gc.join();
     }
-    stopGCFlag = false;
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        stopGCFlag = false;
+    }
     gc = std::thread(&serviceManager::garbageCollector, this);
 }
 
 void serviceManager::stopGC(){
-    stopGCFlag = true;
-}
\ No newline at end of file
+    {
+        std::lock_guard<std::mutex> lock(clockMutex);
+        stopGCFlag = true;
+    }
+    gcWake.notify_all();
+}
@@ -0,0 +1,81 @@
+#include "shapeBuckets.h"
+#include "core.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace cinrt::model;
+
+ShapeBuckets::ShapeBuckets(Model* model, const BucketOptions& options) : _model(model), _options(options) {
+  const std::vector<TensorInfo>& inputs = model->getInputs();
+  if (inputs.empty() || inputs[0].shape.size() != 4 || inputs[0].type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT)
+    throw std::runtime_error("Shape buckets need a float {N, 3, H, W} input");
+  const std::vector<int64_t>& shape = inputs[0].shape;
+  _inputName = inputs[0].name;
+  _batch = std::max<int64_t>(shape[0], 0);
+  std::vector<std::pair<int, int>> sizes = options.sizes;
+  if (sizes.empty() && shape[2] > 0 && shape[3] > 0)
+    sizes.emplace_back(static_cast<int>(shape[3]), static_cast<int>(shape[2]));
+  if (sizes.empty())
+    throw std::runtime_error("Shape buckets need sizes for a dynamic input");
+  for (const auto& [width, height] : sizes){
+    if (width <= 0 || height <= 0 || (shape[3] > 0 && width != shape[3]) || (shape[2] > 0 && height != shape[2]))
+      throw std::runtime_error("Bucket size does not match the model input");
+    std::unique_ptr<Bucket> bucket = std::make_unique<Bucket>();
+    bucket->width = width;
+    bucket->height = height;
+    _buckets.push_back(std::move(bucket));
+  }
+  std::sort(_buckets.begin(), _buckets.end(), [](const std::unique_ptr<Bucket>& a, const std::unique_ptr<Bucket>& b){
+    return static_cast<int64_t>(a->width) * a->height < static_cast<int64_t>(b->width) * b->height;
+  });
+}
+
+ShapeBuckets::Bucket& ShapeBuckets::pick(int width, int height){
+  for (std::unique_ptr<Bucket>& bucket : _buckets)
+    if (bucket->width >= width && bucket->height >= height)
+      return *bucket;
+  // Too large for every bucket, letterboxed down into the largest.
+  return *_buckets.back();
+}
+
+BucketedOutputs ShapeBuckets::run(const std::vector<ImageView>& images, const Ort::RunOptions& runOptions){
+  if (images.empty())
+    throw std::runtime_error("No images to run");
+  if (_batch > 0 && static_cast<int64_t>(images.size()) != _batch)
+    throw std::runtime_error("Image count does not match the model batch size");
+  int width = 0;
+  int height = 0;
+  for (const ImageView& image : images){
+    width = std::max(width, image.width);
+    height = std::max(height, image.height);
+  }
+  Bucket& bucket = pick(width, height);
+  BucketedOutputs result;
+  result.width = bucket.width;
+  result.height = bucket.height;
+  result.scales.reserve(images.size());
+
+  std::lock_guard<std::mutex> lock(bucket.mutex);
+  const int64_t batch = static_cast<int64_t>(images.size());
+  if (bucket.binding == nullptr || bucket.batch != batch){
+    const std::vector<int64_t> shape = {batch, 3, bucket.height, bucket.width};
+    bucket.input = Ort::Value::CreateTensor<float>(_allocator, shape.data(), shape.size());
+    // No owner, the model owns the buckets.
+    bucket.binding = std::make_unique<Binding>(*_model->_session);
+    bucket.binding->bindInput(_inputName, bucket.input);
+    for (const TensorInfo& output : _model->getOutputs())
+      bucket.binding->bindOutput(output.name);
+    bucket.batch = batch;
+  }
+  float* dst = bucket.input.GetTensorMutableData<float>();
+  const size_t imageSize = static_cast<size_t>(bucket.width) * bucket.height * 3;
+  for (size_t i = 0; i < images.size(); ++i){
+    Letterbox box = Letterbox::fit(images[i].width, images[i].height, bucket.width, bucket.height, _options.upscale);
+    letterboxToTensor(images[i], dst + i * imageSize, bucket.width, bucket.height, box, _options.preprocess, _options.padValue);
+    result.scales.push_back(Rescale::letterbox(box, images[i].width, images[i].height));
+  }
+  _model->runBound(*bucket.binding, runOptions);
+  // Arena outputs are fresh every run, they stay valid after the lock.
+  result.outputs = bucket.binding->outputs();
+  return result;
+}
@@ -0,0 +1,235 @@
+#include "sharedMemory.h"
+#include <cstdint>
+#include <new>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cinrt::model;
+
+namespace
+{
+  // Both ring headers live in the first page, the rings follow.
+  constexpr size_t HEADER_BYTES = 4096;
+  constexpr uint32_t MAX_MESSAGE = 16u << 20;
+
+#ifndef _WIN32
+  bool sendAll(int socket, const char* data, size_t size){
+    while (size > 0){
+      ssize_t count = ::send(socket, data, size, MSG_NOSIGNAL);
+      if (count <= 0)
+        return false;
+      data += count;
+      size -= static_cast<size_t>(count);
+    }
+    return true;
+  }
+
+  bool receiveAll(int socket, char* data, size_t size){
+    while (size > 0){
+      ssize_t count = ::recv(socket, data, size, 0);
+      if (count <= 0)
+        return false;
+      data += count;
+      size -= static_cast<size_t>(count);
+    }
+    return true;
+  }
+
+  int createSharedFile(size_t bytes){
+#ifdef __linux__
+    int fd = ::memfd_create("cinnamon", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    // No memfd, the name is unlinked at once and only the descriptor is shared.
+    std::string name = "/cinnamon." + std::to_string(::getpid()) + "." + std::to_string(reinterpret_cast<uintptr_t>(&bytes));
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+      ::shm_unlink(name.c_str());
+#endif
+    if (fd < 0)
+      return -1;
+    if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0){
+      ::close(fd);
+      return -1;
+    }
+#ifdef F_ADD_SEALS
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0){
+      ::close(fd);
+      return -1;
+    }
+#endif
+    return fd;
+  }
+#endif
+}
+
+bool SharedRing::allocate(uint64_t bytes, uint64_t& offset){
+  bytes = (bytes + 63) & ~uint64_t(63);
+  if (bytes > _size)
+    return false;
+  const uint64_t head = _header->head.load(std::memory_order_relaxed);
+  const uint64_t tail = _header->tail.load(std::memory_order_acquire);
+  // Blocks never wrap, the end of the ring is skipped instead. Skipped
+  // bytes count as used until released, unless nothing is left to release.
+  const uint64_t at = head % _size;
+  const uint64_t pad = at + bytes > _size ? _size - at : 0;
+  const uint64_t used = head == tail ? head + pad : tail;
+  if (head + pad + bytes - used > _size)
+    return false;
+  offset = (head + pad) % _size;
+  _header->head.store(head + pad + bytes, std::memory_order_release);
+  return true;
+}
+
+SharedRegion::SharedRegion(size_t ringBytes){
+#ifndef _WIN32
+  _ringBytes = (static_cast<uint64_t>(ringBytes) + 63) & ~uint64_t(63);
+  if (_ringBytes == 0)
+    throw std::runtime_error("Shared rings need a size");
+  _bytes = HEADER_BYTES + 2 * _ringBytes;
+  _fd = createSharedFile(_bytes);
+  if (_fd < 0)
+    throw std::runtime_error("Cannot create shared memory");
+  map();
+  new (_base) SharedRingHeader();
+  new (static_cast<char*>(_base) + sizeof(SharedRingHeader)) SharedRingHeader();
+#else
+  (void)ringBytes;
+  throw std::runtime_error("Shared memory is not supported on Windows");
+#endif
+}
+
+SharedRegion SharedRegion::attach(int fd, uint64_t ringBytes){
+  SharedRegion region;
+  region._fd = fd;
+#ifndef _WIN32
+  if (ringBytes == 0 || ringBytes % 64 != 0 || ringBytes > (SIZE_MAX - HEADER_BYTES) / 2)
+    throw std::runtime_error("Invalid shared memory");
+#ifdef F_GET_SEALS
+  // A peer able to shrink the file could fault every access to the mapping.
+  const int required = F_SEAL_SHRINK | F_SEAL_GROW;
+  int seals = ::fcntl(fd, F_GET_SEALS);
+  if (seals < 0 || (seals & required) != required)
+    throw std::runtime_error("Shared memory is not sealed");
+#endif
+  region._ringBytes = ringBytes;
+  region._bytes = HEADER_BYTES + 2 * static_cast<size_t>(ringBytes);
+  struct stat info;
+  if (::fstat(fd, &info) != 0 || info.st_size < 0 || static_cast<uint64_t>(info.st_size) < region._bytes)
+    throw std::runtime_error("Invalid shared memory");
+  region.map();
+#else
+  (void)ringBytes;
+  throw std::runtime_error("Shared memory is not supported on Windows");
+#endif
+  return region;
+}
+
+SharedRegion::SharedRegion(SharedRegion&& other) noexcept
+  : _fd(other._fd), _base(other._base), _bytes(other._bytes), _ringBytes(other._ringBytes) {
+  other._fd = -1;
+  other._base = nullptr;
+}
+
+SharedRegion::~SharedRegion(){
+#ifndef _WIN32
+  if (_base != nullptr)
+    ::munmap(_base, _bytes);
+  if (_fd >= 0)
+    ::close(_fd);
+#endif
+}
+
+void SharedRegion::map(){
+#ifndef _WIN32
+  void* base = ::mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (base == MAP_FAILED)
+    throw std::runtime_error("Cannot map shared memory");
+  _base = base;
+#endif
+}
+
+SharedRing SharedRegion::requests() const {
+  uint8_t* base = static_cast<uint8_t*>(_base);
+  return SharedRing(reinterpret_cast<SharedRingHeader*>(base), base + HEADER_BYTES, _ringBytes);
+}
+
+SharedRing SharedRegion::responses() const {
+  uint8_t* base = static_cast<uint8_t*>(_base);
+  return SharedRing(reinterpret_cast<SharedRingHeader*>(base + sizeof(SharedRingHeader)), base + HEADER_BYTES + _ringBytes, _ringBytes);
+}
+
+bool WireMessage::send(int socket) const {
+#ifndef _WIN32
+  const uint32_t size = static_cast<uint32_t>(_bytes.size());
+  return sendAll(socket, reinterpret_cast<const char*>(&size), sizeof(size)) && sendAll(socket, _bytes.data(), _bytes.size());
+#else
+  (void)socket;
+  return false;
+#endif
+}
+
+bool WireMessage::receive(int socket){
+  clear();
+#ifndef _WIN32
+  uint32_t size = 0;
+  if (!receiveAll(socket, reinterpret_cast<char*>(&size), sizeof(size)) || size > MAX_MESSAGE)
+    return false;
+  _bytes.resize(size);
+  return receiveAll(socket, _bytes.data(), size);
+#else
+  (void)socket;
+  return false;
+#endif
+}
+
+bool cinrt::model::sendDescriptor(int socket, int fd){
+#ifndef _WIN32
+  char byte = 0;
+  iovec data{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr message{};
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+  return ::sendmsg(socket, &message, MSG_NOSIGNAL) == 1;
+#else
+  (void)socket;
+  (void)fd;
+  return false;
+#endif
+}
+
+int cinrt::model::receiveDescriptor(int socket){
+#ifndef _WIN32
+  char byte = 0;
+  iovec data{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr message{};
+  message.msg_iov = &data;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  if (::recvmsg(socket, &message, 0) != 1)
+    return -1;
+  cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+    return -1;
+  int fd = -1;
+  std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+  return fd;
+#else
+  (void)socket;
+  return -1;
+#endif
+}
@@ -0,0 +1,189 @@
+#include "tensor.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  int64_t readIndex(const char* cell, ONNXTensorElementDataType type){
+    switch (type){
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: { float value; std::memcpy(&value, cell, sizeof(value)); return static_cast<int64_t>(value); }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: { double value; std::memcpy(&value, cell, sizeof(value)); return static_cast<int64_t>(value); }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: { int32_t value; std::memcpy(&value, cell, sizeof(value)); return value; }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64: { int64_t value; std::memcpy(&value, cell, sizeof(value)); return value; }
+    default:
+      throw std::runtime_error("Unsupported batch index type");
+    }
+  }
+
+  void writeIndex(char* cell, ONNXTensorElementDataType type, int64_t index){
+    switch (type){
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT: { float value = static_cast<float>(index); std::memcpy(cell, &value, sizeof(value)); break; }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE: { double value = static_cast<double>(index); std::memcpy(cell, &value, sizeof(value)); break; }
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32: { int32_t value = static_cast<int32_t>(index); std::memcpy(cell, &value, sizeof(value)); break; }
+    default: std::memcpy(cell, &index, sizeof(index)); break;
+    }
+  }
+}
+
+namespace cinrt::model
+{
+  size_t elementSize(ONNXTensorElementDataType type){
+    switch (type){
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT8:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BOOL:
+      return 1;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT16:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_BFLOAT16:
+      return 2;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT32:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT32:
+      return 4;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_DOUBLE:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_INT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT64:
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_COMPLEX64:
+      return 8;
+    case ONNX_TENSOR_ELEMENT_DATA_TYPE_COMPLEX128:
+      return 16;
+    default:
+      return 0;
+    }
+  }
+
+  size_t tensorBytes(const Ort::Value& value){
+    auto info = value.GetTensorTypeAndShapeInfo();
+    return info.GetElementCount() * elementSize(info.GetElementType());
+  }
+
+  uint16_t toHalf(float value){
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent == 128 + 15)
+      return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    if (exponent >= 31)
+      return static_cast<uint16_t>(sign | 0x7c00);
+    // Subnormal halves keep the implicit bit, shifted into the mantissa.
+    int shift = 13;
+    uint32_t base = static_cast<uint32_t>(exponent) << 10;
+    if (exponent <= 0){
+      if (exponent < -10)
+        return static_cast<uint16_t>(sign);
+      mantissa |= 0x800000;
+      shift = 14 - exponent;
+      base = 0;
+    }
+    uint32_t half = base | (mantissa >> shift);
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t middle = 1u << (shift - 1);
+    // A carry out of the mantissa correctly bumps the exponent.
+    if (rest > middle || (rest == middle && (half & 1)))
+      ++half;
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  Ort::Value cloneTensor(const Ort::Value& value, OrtAllocator* allocator){
+    auto info = value.GetTensorTypeAndShapeInfo();
+    std::vector<int64_t> shape = info.GetShape();
+    ONNXTensorElementDataType type = info.GetElementType();
+    if (elementSize(type) == 0)
+      throw std::runtime_error("Unsupported tensor element type");
+    Ort::Value copy = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), type);
+    std::memcpy(copy.GetTensorMutableRawData(), value.GetTensorRawData(), tensorBytes(value));
+    return copy;
+  }
+
+  Ort::Value concatTensors(const std::vector<const Ort::Value*>& values, OrtAllocator* allocator){
+    if (values.empty())
+      throw std::runtime_error("Nothing to concatenate");
+    auto info = values[0]->GetTensorTypeAndShapeInfo();
+    std::vector<int64_t> shape = info.GetShape();
+    ONNXTensorElementDataType type = info.GetElementType();
+    if (shape.empty() || elementSize(type) == 0)
+      throw std::runtime_error("Tensor cannot be concatenated");
+    int64_t rows = 0;
+    for (const Ort::Value* value : values){
+      auto valueInfo = value->GetTensorTypeAndShapeInfo();
+      std::vector<int64_t> valueShape = valueInfo.GetShape();
+      if (valueInfo.GetElementType() != type || valueShape.size() != shape.size()
+          || !std::equal(valueShape.begin() + 1, valueShape.end(), shape.begin() + 1))
+        throw std::runtime_error("Tensor shapes or types do not match");
+      rows += valueShape[0];
+    }
+    shape[0] = rows;
+    Ort::Value merged = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), type);
+    char* dst = static_cast<char*>(merged.GetTensorMutableRawData());
+    for (const Ort::Value* value : values){
+      size_t bytes = tensorBytes(*value);
+      std::memcpy(dst, value->GetTensorRawData(), bytes);
+      dst += bytes;
+    }
+    return merged;
+  }
+
+  std::vector<Ort::Value> splitTensor(const Ort::Value& value, const std::vector<int64_t>& rows, OrtAllocator* allocator){
+    auto info = value.GetTensorTypeAndShapeInfo();
+    std::vector<int64_t> shape = info.GetShape();
+    ONNXTensorElementDataType type = info.GetElementType();
+    int64_t total = 0;
+    for (int64_t count : rows)
+      total += count;
+    if (shape.empty() || shape[0] != total || elementSize(type) == 0)
+      throw std::runtime_error("Tensor cannot be split along dim 0");
+    size_t rowBytes = total > 0 ? tensorBytes(value) / total : 0;
+    const char* src = static_cast<const char*>(value.GetTensorRawData());
+    std::vector<Ort::Value> parts;
+    parts.reserve(rows.size());
+    for (int64_t count : rows){
+      shape[0] = count;
+      Ort::Value part = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), type);
+      std::memcpy(part.GetTensorMutableRawData(), src, rowBytes * count);
+      src += rowBytes * count;
+      parts.push_back(std::move(part));
+    }
+    return parts;
+  }
+
+  std::vector<Ort::Value> splitByBatchIndex(const Ort::Value& value, const std::vector<int64_t>& batches, OrtAllocator* allocator){
+    auto info = value.GetTensorTypeAndShapeInfo();
+    std::vector<int64_t> shape = info.GetShape();
+    ONNXTensorElementDataType type = info.GetElementType();
+    if (shape.size() != 2 || shape[1] < 1 || elementSize(type) == 0)
+      throw std::runtime_error("Tensor cannot be split by batch index");
+    // First batch index of every part, then the total.
+    std::vector<int64_t> starts(1, 0);
+    for (int64_t count : batches)
+      starts.push_back(starts.back() + count);
+    const size_t rowBytes = static_cast<size_t>(shape[1]) * elementSize(type);
+    const char* src = static_cast<const char*>(value.GetTensorRawData());
+    std::vector<std::vector<int64_t>> picked(batches.size());
+    for (int64_t row = 0; row < shape[0]; ++row){
+      int64_t index = readIndex(src + row * rowBytes, type);
+      if (index < 0 || index >= starts.back())
+        continue;
+      size_t part = std::upper_bound(starts.begin(), starts.end(), index) - starts.begin() - 1;
+      picked[part].push_back(row);
+    }
+    std::vector<Ort::Value> parts;
+    parts.reserve(batches.size());
+    for (size_t part = 0; part < batches.size(); ++part){
+      shape[0] = static_cast<int64_t>(picked[part].size());
+      Ort::Value split = Ort::Value::CreateTensor(allocator, shape.data(), shape.size(), type);
+      char* dst = static_cast<char*>(split.GetTensorMutableRawData());
+      for (int64_t row : picked[part]){
+        std::memcpy(dst, src + row * rowBytes, rowBytes);
+        writeIndex(dst, type, readIndex(dst, type) - starts[part]);
+        dst += rowBytes;
+      }
+      parts.push_back(std::move(split));
+    }
+    return parts;
+  }
+};
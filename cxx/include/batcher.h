@@ -0,0 +1,61 @@
+#ifndef __CRT_BATCHER_H__
+#define __CRT_BATCHER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+namespace cinrt::model
+{
+  class Model;
+
+  // Collects concurrent requests of one model and runs them as a single
+  // batch, concatenated along dim 0. A batch is dispatched once it holds
+  // maxBatchSize rows or its oldest request waited maxWait.
+  // The first output is split back along dim 0 when it shares the batch
+  // dimension of the input. {N, columns} outputs with their own dynamic
+  // dim 0, e.g. end-to-end YOLO rows, are routed by their batch index in
+  // column 0 instead. Other models are refused.
+  class Batcher
+  {
+  protected:
+    struct Request
+    {
+      Ort::Value input;
+      std::vector<int64_t> shape;
+      ONNXTensorElementDataType type;
+      std::promise<std::shared_ptr<std::vector<Ort::Value>>> promise;
+      std::chrono::steady_clock::time_point enqueued;
+    };
+
+    Model* _model;
+    // Output rows carry their batch index rather than being batch-major.
+    bool _batchIndex = false;
+    size_t _maxBatchSize;
+    std::chrono::microseconds _maxWait;
+    Ort::AllocatorWithDefaultOptions _allocator;
+    std::deque<Request> _queue;
+    size_t _queuedRows = 0;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+    std::thread _worker;
+
+    void loop();
+    void dispatch(std::vector<Request>& batch);
+    static bool compatible(const Request& a, const Request& b);
+
+  public:
+    Batcher(Model* model, size_t maxBatchSize = 8, std::chrono::microseconds maxWait = std::chrono::microseconds(2000));
+    ~Batcher();
+    // Input is copied, so the caller may release it right away.
+    std::future<std::shared_ptr<std::vector<Ort::Value>>> submit(const Ort::Value& inputs);
+  };
+};
+
+#endif // __CRT_BATCHER_H__
@@ -0,0 +1,38 @@
+#ifndef __CRT_BINDING_H__
+#define __CRT_BINDING_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+namespace cinrt::model
+{
+  class Model;
+
+  // Inputs and outputs bound once to a session and reused across runs.
+  // Outputs bound to a caller tensor are written in place; outputs bound
+  // without one are allocated from the session arena, which recycles the
+  // chunks of released outputs, so dynamic shapes such as {N, 7} work too.
+  // A binding must only be used by one thread at a time.
+  class Binding
+  {
+  protected:
+    std::shared_ptr<Model> _owner;
+    Ort::Session& _session;
+    Ort::IoBinding _binding;
+    Ort::MemoryInfo _memoryInfo;
+
+  public:
+    Binding(Ort::Session& session, std::shared_ptr<Model> owner = nullptr);
+    void bindInput(const std::string& name, const Ort::Value& value);
+    void bindOutput(const std::string& name, const Ort::Value& value);
+    void bindOutput(const std::string& name);
+    void clear();
+    void run(const Ort::RunOptions& runOptions = Ort::RunOptions());
+    // Outputs of the last run, sharing memory with the bound buffers.
+    std::vector<Ort::Value> outputs() const;
+  };
+};
+
+#endif // __CRT_BINDING_H__
@@ -0,0 +1,103 @@
+#ifndef __CRT_BUFFER_POOL_H__
+#define __CRT_BUFFER_POOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "metrics.h"
+
+namespace cinrt::model
+{
+  struct BufferPoolStats
+  {
+    // Acquires served from a recycled buffer, and from a new allocation.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Bytes held in the shared free lists, thread caches excluded.
+    size_t pooledBytes = 0;
+  };
+
+  // Recycles 64-byte aligned tensor buffers by power-of-two size class.
+  // Buffers up to 1 MiB are released to a small cache of the releasing
+  // thread and acquired from it first, larger ones and cache overflow go
+  // through free lists shared under a lock. Buffers over 1 GiB are not
+  // pooled.
+  class BufferPool
+  {
+  public:
+    static constexpr size_t ALIGNMENT = 64;
+    static constexpr int MIN_SHIFT = 6;
+    static constexpr int MAX_SHIFT = 30;
+    static constexpr size_t CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+
+  protected:
+    struct State
+    {
+      std::mutex mutex;
+      std::vector<void*> free[CLASSES];
+      size_t pooledBytes = 0;
+      size_t maxPooledBytes = 0;
+      Counter hits;
+      Counter misses;
+      ~State();
+    };
+    std::shared_ptr<State> _state;
+    Ort::MemoryInfo _memoryInfo{nullptr};
+
+  public:
+    // Owns its memory and hands it back to the pool on destruction. The
+    // pool state lives as long as any of its buffers.
+    class Buffer
+    {
+    protected:
+      std::shared_ptr<State> _state;
+      void* _data = nullptr;
+      size_t _size = 0;
+      int _class = -1;
+
+      friend class BufferPool;
+
+    public:
+      Buffer() = default;
+      Buffer(Buffer&& other) noexcept;
+      Buffer& operator=(Buffer&& other) noexcept;
+      Buffer(const Buffer&) = delete;
+      Buffer& operator=(const Buffer&) = delete;
+      ~Buffer() { release(); }
+
+      void* data() const { return _data; }
+      // Capacity, at least the size acquired.
+      size_t size() const { return _size; }
+      void release();
+    };
+
+    // A tensor over a pooled buffer, the value is destroyed first.
+    struct Tensor
+    {
+      Buffer buffer;
+      Ort::Value value{nullptr};
+    };
+
+    // maxPooledBytes bounds the shared free lists, buffers released
+    // beyond it are freed.
+    BufferPool(size_t maxPooledBytes = size_t(1) << 30);
+
+    Buffer acquire(size_t bytes);
+    // Uninitialized dense tensor, strings are not supported.
+    Tensor tensor(ONNXTensorElementDataType type, const std::vector<int64_t>& shape);
+    template <typename T>
+    Tensor tensor(const std::vector<int64_t>& shape) {
+      return tensor(Ort::TypeToTensorType<T>::type, shape);
+    }
+    // Deep copy of a dense tensor into a pooled buffer.
+    Tensor clone(const Ort::Value& value);
+    // Frees the shared free lists.
+    void trim();
+    BufferPoolStats getStats() const;
+  };
+};
+
+#endif // __CRT_BUFFER_POOL_H__
@@ -3,21 +3,156 @@
 
 #include <string>
 #include <map>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <future>
+#include <mutex>
 #include <onnxruntime_cxx_api.h>
+#include "batcher.h"
+#include "binding.h"
+#include "bufferPool.h"
+#include "executor.h"
+#include "frameStream.h"
+#include "localClient.h"
+#include "localServer.h"
+#include "mappedFile.h"
+#include "metrics.h"
+#include "modelCache.h"
+#include "modelGraph.h"
+#include "preprocess.h"
+#include "providers.h"
+#include "registry.h"
+#include "resultCache.h"
+#include "scheduler.h"
+#include "shapeBuckets.h"
 // #include <include/interface.h>
 
 namespace cinrt::model
 {
-  class Model
+  // Graph input or output, cached when the model is loaded.
+  // Dynamic dimensions are -1, non-tensor values have an undefined type.
+  struct TensorInfo
+  {
+    std::string name;
+    std::vector<int64_t> shape;
+    // Parameter names of the dimensions, empty for fixed or unnamed ones.
+    std::vector<std::string> symbols;
+    ONNXTensorElementDataType type = ONNX_TENSOR_ELEMENT_DATA_TYPE_UNDEFINED;
+    // Outputs only: every dimension is fixed or named after an input one,
+    // so the shape follows from the input shapes and not from the data.
+    bool inputSized = false;
+  };
+
+  // Process-wide ORT thread pools shared by every session of a modelManager.
+  // Affinities use the ORT format, e.g. "1,2;3,4" pins the 2 intra-op
+  // workers besides the caller thread, so intraThreads must be set with them.
+  struct ThreadPoolOptions
+  {
+    int intraThreads = 0;
+    int interThreads = 0;
+    bool spinning = true;
+    bool denormalAsZero = false;
+    std::string intraAffinities;
+  };
+
+  // How a session was loaded, cacheHit is set when graph optimization was
+  // skipped thanks to a cached optimized model. memoryBytes is the resident
+  // memory growth measured across the load.
+  struct LoadStats
+  {
+    double loadMs = 0;
+    bool cacheHit = false;
+    std::string cachePath;
+    size_t memoryBytes = 0;
+  };
+
+  // Operations in flight that a stop or a destructor waits for.
+  class PendingCount
+  {
+  protected:
+    std::mutex _mutex;
+    std::condition_variable _idle;
+    int _count = 0;
+
+  public:
+    void add() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_count;
+    }
+    void done() {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_count == 0)
+        _idle.notify_all();
+    }
+    void wait() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _idle.wait(lock, [this]{ return _count == 0; });
+    }
+  };
+
+  // Completion of Model::runCallback, outputs are null when the run failed.
+  using RunCallback = std::function<void(std::shared_ptr<std::vector<Ort::Value>> outputs)>;
+
+  class Model : public std::enable_shared_from_this<Model>
   {
   protected:
     std::shared_ptr<Ort::Env> _env;           
     std::shared_ptr<Ort::Allocator> _allocator;
     std::shared_ptr<const char*> inputNames;
     std::shared_ptr<const char*> outputNames;
+    // Must outlive _session.
+    std::shared_ptr<Ort::PrepackedWeightsContainer> _prepacked;
+    std::shared_ptr<MappedFile> _mapping;
+    bool _mapped = false;
+    std::vector<TensorInfo> _inputs;
+    std::vector<TensorInfo> _outputs;
     std::unique_ptr<Ort::Session> _session;
     std::unique_ptr<Ort::SessionOptions> _sessionOptions;
+    // Swapped atomically, runBatched callers hold the batcher they submit to.
+    std::shared_ptr<Batcher> _batcher;
+    std::unique_ptr<ShapeBuckets> _buckets;
+    std::shared_ptr<Executor> _executor;
+    std::atomic<int> _inflight{0};
+    // Requests waiting in the scheduler.
+    std::atomic<int> _queued{0};
+    std::atomic<int64_t> _lastUsed{0};
+    std::atomic<uint64_t> _uses{0};
+    std::string _path;
+    LoadStats _loadStats;
+    // ORT names of the providers the session was given, CPU last.
+    std::vector<std::string> _providers;
+    Ort::Value _inputBuffer{nullptr};
+    // Float planes converted into _inputBuffer for other input types.
+    std::vector<float> _inputScratch;
+    // Shared with the other replicas of the name when managed.
+    std::shared_ptr<ModelMetrics> _metrics;
+    // Second session with ORT profiling on, see setProfiling. Guarded by
+    // _profileMutex, runs sampled on it are counted in _profileRuns.
+    std::shared_ptr<Ort::Session> _profiled;
+    std::mutex _profileMutex;
+    PendingCount _profileRuns;
+    std::atomic<uint32_t> _profileEvery{0};
+    std::atomic<uint64_t> _profileTick{0};
+    // Output shapes last seen for some input shapes, so the next run with
+    // the same inputs writes into pooled buffers.
+    struct OutputPlan
+    {
+      std::vector<std::vector<int64_t>> inputs;
+      std::vector<std::string> outputs;
+      std::vector<std::vector<int64_t>> shapes;
+      std::vector<ONNXTensorElementDataType> types;
+    };
+    std::shared_ptr<BufferPool> _pool;
+    std::shared_ptr<ResultCache> _resultCache;
+    std::shared_ptr<const OutputPlan> _outputPlan;
+    // Cleared for good once a pooled run fails or output shapes change
+    // under the same inputs.
+    std::atomic<bool> _planOutputs{true};
+    // runCallback requests ORT has not called back yet.
+    PendingCount _callbacks;
+    // Last member, its workers run on everything above.
+    std::unique_ptr<Scheduler> _scheduler;
 
   public: 
     Model(
@@ -25,8 +160,8 @@ namespace cinrt::model
       bool parallel = true, 
       int graphOpLevel = 0, 
       int interThreads = 0, 
-      int intraThreads = 0
-      // std::vector<std::string>* providers = nullptr
+      int intraThreads = 0,
+      const std::vector<ExecutionProvider>& providers = {}
     );
     static std::shared_ptr<Model> create(
       std::shared_ptr<Ort::Env> env, 
@@ -35,10 +170,17 @@ namespace cinrt::model
       bool parallel = true, 
       int graphOpLevel = 0, 
       int interThreads = 0, 
-      int intraThreads = 0
+      int intraThreads = 0,
+      std::shared_ptr<Ort::PrepackedWeightsContainer> prepacked = nullptr,
+      bool globalThreads = false,
+      std::string optimizedPath = "",
+      bool mapped = false,
+      const std::vector<ExecutionProvider>& providers = {}
     ) {
-        return std::shared_ptr<Model>(new Model(env, allocator, model, parallel, graphOpLevel, interThreads, intraThreads));
+        return std::shared_ptr<Model>(new Model(env, allocator, model, parallel, graphOpLevel, interThreads, intraThreads, prepacked, globalThreads, optimizedPath, mapped, providers));
     }
+    // Waits for the runCallback requests in flight.
+    ~Model();
 
   protected: 
     Model(
@@ -48,49 +190,327 @@ namespace cinrt::model
       bool parallel = true,
       int graphOpLevel = 0,
       int interThreads = 0,
-      int intraThreads = 0
-      // std::vector<std::string>* providers = nullptr
+      int intraThreads = 0,
+      std::shared_ptr<Ort::PrepackedWeightsContainer> prepacked = nullptr,
+      bool globalThreads = false,
+      std::string optimizedPath = "",
+      bool mapped = false,
+      const std::vector<ExecutionProvider>& providers = {}
     );
+    // globalThreads makes the session use the env thread pools, thread counts are then ignored.
     static std::unique_ptr<Ort::SessionOptions> getSessionOptions(
       bool parallel = true,
       int graphOpLevel = 0,
+      int interThreads = 0,
       int intraThreads = 0,
-      int interThreads = 0
+      bool globalThreads = false
     );
 
+    // Loads optimizedPath when it exists, otherwise loads model and saves
+    // its optimized graph to optimizedPath. Mapped models are built from an
+    // mmap of the file rather than read by ORT.
+    void loadSession(const std::string& model, const std::string& optimizedPath = "");
+    // mapping is set when the session uses the bytes of a mapped .ort file,
+    // it must then outlive the session.
+    std::unique_ptr<Ort::Session> openSession(const std::string& path, const Ort::SessionOptions& options, std::shared_ptr<MappedFile>& mapping);
+    // The profiling session when this run is sampled, null otherwise.
+    std::shared_ptr<Ort::Session> sampleProfiled();
+    // Null when outputs cannot be preallocated, the caller then runs as usual
+    // and hands the outputs to planOutputs.
+    std::shared_ptr<std::vector<Ort::Value>> runPooled(
+      Ort::Session& session,
+      const Ort::RunOptions& runOptions,
+      const char* const* inputHeads,
+      const Ort::Value* inputs,
+      size_t inputCount,
+      const char* const* outputHeads,
+      size_t outputCount);
+    void planOutputs(
+      const Ort::Value* inputs,
+      size_t inputCount,
+      const char* const* outputHeads,
+      const std::vector<Ort::Value>& outputs);
+    void loadIO();
+
+    // Runs a binding of this session, counted like run().
+    void runBound(Binding& binding, const Ort::RunOptions& runOptions);
+
     // friend class modelManager;
     friend class modelManager;
+    friend class ShapeBuckets;
+    friend class Scheduler;
+    friend class FrameStream;
 
     public:
     std::shared_ptr<std::vector<Ort::Value>> run(
       const Ort::Value& inputs,
       std::shared_ptr<const char*> outputHead = nullptr,
       const Ort::RunOptions& runOptions = Ort::RunOptions());
+    // Runs named inputs once and fetches any subset of outputs, all of them
+    // when outputNames is empty. Results follow the order of outputNames.
+    std::shared_ptr<std::vector<Ort::Value>> run(
+      const std::vector<std::string>& inputNames,
+      const std::vector<Ort::Value>& inputs,
+      const std::vector<std::string>& outputNames = {},
+      const Ort::RunOptions& runOptions = Ort::RunOptions());
+    const std::vector<TensorInfo>& getInputs() const { return _inputs; }
+    const std::vector<TensorInfo>& getOutputs() const { return _outputs; }
+    const LoadStats& getLoadStats() const { return _loadStats; }
+    // Runs synthetic zero inputs through every output, dynamic dims set to 1,
+    // so lazy initialization is paid before real traffic. Throws when a run
+    // fails.
+    void warmup(int runs = 1);
+    const std::string& getPath() const { return _path; }
+    const std::vector<std::string>& getProviders() const { return _providers; }
+    // Runs warm-up inputs once with profiling on and reports the provider
+    // of every node. Replaces any profiling in progress, and runs served
+    // meanwhile are profiled too.
+    std::vector<NodePlacement> getNodePlacement();
+    // Records a use, called when the model is routed a request.
+    void touch();
+    std::chrono::steady_clock::time_point lastUsed() const;
+    uint64_t uses() const { return _uses.load(std::memory_order_relaxed); }
+    // Number of runs currently executing on this session.
+    int load() const { return _inflight.load(std::memory_order_relaxed); }
+    int queued() const { return _queued.load(std::memory_order_relaxed); }
+    // Copies inputs and queues the run on the model executor.
     std::future<std::shared_ptr<std::vector<Ort::Value>>> runAsync(
       const Ort::Value& inputs,
       std::shared_ptr<const char*> outputHead = nullptr,
-      const Ort::RunOptions runOptions = Ort::RunOptions());
+      Ort::RunOptions runOptions = Ort::RunOptions());
+    // Non-blocking runs on Session::RunAsync: no thread waits for them, done
+    // is called on an ORT intra-op thread once the outputs are ready, or
+    // inline on a result cache hit or when the run cannot start. Inputs are
+    // moved in and read in place. The session needs intra-op threads, and
+    // done must not throw nor release the last reference to the model.
+    void runCallback(
+      Ort::Value inputs,
+      RunCallback done,
+      std::shared_ptr<const char*> outputHead = nullptr,
+      Ort::RunOptions runOptions = Ort::RunOptions());
+    void runCallback(
+      std::vector<std::string> inputNames,
+      std::vector<Ort::Value> inputs,
+      RunCallback done,
+      std::vector<std::string> outputNames = {},
+      Ort::RunOptions runOptions = Ort::RunOptions());
+    // Defaults to Executor::forSessions() for the intra-op threads of the model.
+    void setExecutor(std::shared_ptr<Executor> executor);
+    // Once run() has seen the output shapes of some input shapes, later runs
+    // with the same shapes write their outputs to pooled buffers, returned to
+    // the pool with the result. Values moved out of the result must not
+    // outlive it. Null disables.
+    void setBufferPool(std::shared_ptr<BufferPool> pool);
+    // run() answers inputs it has seen from the cache, without running the
+    // session, see ResultCache. Replicas may share a cache. Null disables.
+    void setResultCache(std::shared_ptr<ResultCache> cache);
+    std::shared_ptr<ResultCache> getResultCache() const { return std::atomic_load(&_resultCache); }
+
+    const ModelMetrics& getMetrics() const { return *_metrics; }
+    // ORT profiles whole sessions, so one run in every is routed to a second
+    // session loaded with profiling on, prefix names its trace file. The
+    // profiling session doubles the memory of the model until stopped.
+    void setProfiling(uint32_t every, const std::string& prefix = "cinnamon_profile");
+    // Waits for sampled runs in progress and returns the trace file, empty
+    // when profiling was off.
+    std::string stopProfiling();
+
+    // Zero-copy run path, see Binding. Binds the first input, and the first
+    // output to the caller buffer or to the session arena when none is given.
+    std::unique_ptr<Binding> createBinding();
+    std::unique_ptr<Binding> createBinding(const Ort::Value& inputs, const Ort::Value* outputs = nullptr);
+
+    // Dynamic micro-batching, see Batcher. Throws when the first output
+    // cannot be split back per request. Disabling lets the batches already
+    // queued finish.
+    void enableBatching(size_t maxBatchSize = 8, int maxWaitMicros = 2000);
+    void disableBatching();
+    bool batching() const { return std::atomic_load(&_batcher) != nullptr; }
+    std::future<std::shared_ptr<std::vector<Ort::Value>>> runBatched(const Ort::Value& inputs);
+
+    // Variable-size images run at fixed bucket shapes, see ShapeBuckets.
+    // Enable before sending traffic.
+    void enableShapeBuckets(const BucketOptions& options = BucketOptions());
+    void disableShapeBuckets();
+    BucketedOutputs runBucketed(const std::vector<ImageView>& images, const Ort::RunOptions& runOptions = Ort::RunOptions());
+
+    // Deadline and priority scheduling, see Scheduler. Enable before sending
+    // traffic. Models sharing a pool share its threads.
+    void enableScheduling(const SchedulerOptions& options = SchedulerOptions(), std::shared_ptr<SchedulerPool> pool = nullptr);
+    void disableScheduling();
+    std::future<std::shared_ptr<std::vector<Ort::Value>>> runScheduled(
+      const Ort::Value& inputs,
+      const RequestOptions& request,
+      std::shared_ptr<const char*> outputHead = nullptr,
+      Ort::RunOptions runOptions = Ort::RunOptions());
+
+    // Fills an input tensor owned by the model from images, 3 channels per
+    // image, see imagesToTensor. shape defaults to the first input with a
+    // dynamic batch set to the image count. The tensor has the type of the
+    // first input: float, float16, or uint8 holding the resized pixels,
+    // which does not take mean or std. Other types throw. The buffer is
+    // reused while the shape holds, so callers sharing a model must not
+    // preprocess concurrently.
+    Ort::Value& preprocess(
+      const std::vector<ImageView>& images,
+      std::vector<int64_t> shape = {},
+      const PreprocessOptions& options = PreprocessOptions());
   };
 
 
   class modelManager
   {
     protected:
-      std::map<std::string, std::shared_ptr<Model>> _models;
+      struct Usage
+      {
+        std::chrono::steady_clock::time_point lastUsed;
+        uint64_t uses = 0;
+      };
+
+      // Every model name maps to one or more session replicas.
+      ModelRegistry _models;
+      // Replicas of the same model file share their prepacked weights.
+      std::map<std::string, std::shared_ptr<Ort::PrepackedWeightsContainer>> _prepacked;
       std::shared_ptr<Ort::Env> _env;
       std::shared_ptr<Ort::Allocator> _allocator;
+      bool _globalThreads = false;
+      // Runs asynchronous requests of models on the global thread pools.
+      std::shared_ptr<Executor> _executor;
+      std::shared_ptr<ModelCache> _cache;
+      bool _mapped = true;
+      std::shared_ptr<BufferPool> _pool = std::make_shared<BufferPool>();
+      // Scheduling of models created afterwards, null when off.
+      std::shared_ptr<const SchedulerOptions> _scheduling;
+      // Threads and watchdog of every scheduled model, whatever the replicas.
+      std::shared_ptr<SchedulerPool> _schedulerPool;
+      // Guards _prepacked and _pending, lookups never take it.
+      std::mutex _modelsMutex;
+      // Background loader and loads in progress, see preloadModel.
+      std::shared_ptr<Executor> _loader;
+      std::map<std::string, std::shared_future<Model*>> _pending;
+      // Per model name, kept across reloads and evictions. Guarded by _modelsMutex.
+      std::map<std::string, std::shared_ptr<ModelMetrics>> _metrics;
+
+      std::vector<std::shared_ptr<Model>> buildModels(
+        const std::string& model,
+        bool parallel,
+        int graphOpLevel,
+        int interThreads,
+        int intraThreads,
+        int replicas,
+        const std::vector<ExecutionProvider>& providers);
+      std::shared_ptr<Model> pickReplica(const std::string& model);
+      // True when a replica is running or held outside the registry.
+      bool isPinned(const std::string& model);
+      // Latest use and total uses over all replicas.
+      Usage getUsage(const std::string& model);
+      // Releases removed replicas and records the unload.
+      void unloaded(const std::string& model, std::shared_ptr<const ModelRegistry::Replicas> removed, std::chrono::steady_clock::time_point start);
+      // Drops the prepacked weights of removed replicas, except for file keep.
+      void releasePrepacked(std::shared_ptr<const ModelRegistry::Replicas> replicas, const std::string& keep = "");
+      // Hook for subclasses, called without any manager lock held.
+      virtual void onModelLoaded(const std::string&) {}
+      std::shared_ptr<ModelMetrics> metricsFor(const std::string& model);
+      // Shares the metrics of model with new replicas and records their loads.
+      void attachMetrics(const std::string& model, const std::vector<std::shared_ptr<Model>>& replicas);
 
     public:
       modelManager(std::shared_ptr<Ort::Env> env);
-      ~modelManager();
+      // Creates its own env whose thread pools are shared by all sessions.
+      modelManager(const ThreadPoolOptions& threadPool);
+      virtual ~modelManager();
+      // With replicas > 1, interThreads and intraThreads are the total budget
+      // split across replicas (0 means all hardware threads). Both are ignored
+      // when the manager owns global thread pools. providers are tried in
+      // order, see appendProviders.
       Model* createModel(
         std::string model,
         bool parallel = true,
         int graphOpLevel = 0,
         int interThreads = 0,
-        int intraThreads = 0);
-      Model* getModel(std::string model);
-      void delModel(std::string model);
+        int intraThreads = 0,
+        int replicas = 1,
+        const std::vector<ExecutionProvider>& providers = {});
+      // Loads and warms the model up on a background loader without blocking.
+      // The model is only returned by getModel once the future is ready.
+      // Concurrent preloads of one model share the same load, and a model
+      // already loaded is returned as is. A failed warm-up fails the load.
+      std::shared_future<Model*> preloadModel(
+        std::string model,
+        bool parallel = true,
+        int graphOpLevel = 0,
+        int interThreads = 0,
+        int intraThreads = 0,
+        int replicas = 1,
+        int warmupRuns = 1,
+        const std::vector<ExecutionProvider>& providers = {});
+      // Routes to the least-loaded replica, idle ones first. The handle pins
+      // the replica: it is never evicted and stays alive while held.
+      std::shared_ptr<Model> getModel(std::string model);
+      // Same as getModel, without reporting unknown models.
+      std::shared_ptr<Model> acquireModel(std::string model);
+      // Loads and warms up version, then atomically routes model to it.
+      // In-flight requests finish on the old replicas, nothing is drained.
+      Model* swapModel(
+        std::string model,
+        std::string version,
+        bool parallel = true,
+        int graphOpLevel = 0,
+        int interThreads = 0,
+        int intraThreads = 0,
+        int replicas = 1,
+        int warmupRuns = 1,
+        const std::vector<ExecutionProvider>& providers = {});
+      size_t getReplicas(std::string model);
+      // Cache graph-optimized models in dir, an empty dir disables the cache.
+      void setCacheDir(std::string dir);
+      // Build sessions from memory-mapped model files, on by default.
+      void setMemoryMapping(bool mapped);
+      // Input and output buffers of every model, see Model::setBufferPool.
+      std::shared_ptr<BufferPool> getBufferPool() { return _pool; }
+      // Applies to models created afterwards, null disables pooling.
+      void setBufferPool(std::shared_ptr<BufferPool> pool);
+      // One result cache for the replicas loaded under model, bounded by
+      // maxBytes of outputs, 0 disables. Replicas loaded later start without.
+      std::shared_ptr<ResultCache> setResultCache(std::string model, size_t maxBytes);
+      // Models created afterwards queue runScheduled requests by deadline and
+      // priority, see Scheduler. They share one SchedulerPool of
+      // options->workers threads. Null turns scheduling off.
+      void setScheduling(std::shared_ptr<const SchedulerOptions> options);
+      // Queues on the replica with the fewest runs going and waiting.
+      // Interactive and batch traffic may share a model, see RequestOptions.
+      std::future<std::shared_ptr<std::vector<Ort::Value>>> runScheduled(
+        std::string model,
+        const Ort::Value& inputs,
+        const RequestOptions& request,
+        std::shared_ptr<const char*> outputHead = nullptr);
+      // Load statistics of the first replica.
+      LoadStats getLoadStats(std::string model);
+      // Resident memory of all replicas, as measured at load.
+      size_t getFootprint(std::string model);
+      // False when the model was not registered.
+      bool delModel(std::string model);
+      // Deletes model unless a replica is pinned, checked and removed in one
+      // registry step so no request can pin it in between. False when
+      // pinned or not registered.
+      bool evictModel(const std::string& model);
+
+      // Counters and latency histograms of every model loaded so far.
+      std::vector<ModelStats> getStats();
+      // getStats in the Prometheus text format.
+      std::string exportMetrics();
+      // Atomically replaces path with exportMetrics, e.g. for a textfile collector.
+      void writeMetrics(const std::string& path);
+      // Serves exportMetrics on a Unix domain socket until the manager is destroyed.
+      void serveMetrics(const std::string& socketPath);
+      // Serves the models to other processes on socketPath until the manager
+      // is destroyed, see LocalServer and LocalClient.
+      void serveLocal(const std::string& socketPath);
+
+    protected:
+      // Last members, so they stop before anything they read.
+      std::unique_ptr<LocalServer> _server;
+      std::unique_ptr<MetricsEndpoint> _endpoint;
   };
 };
 
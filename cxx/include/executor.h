@@ -0,0 +1,67 @@
+#ifndef __CRT_EXECUTOR_H__
+#define __CRT_EXECUTOR_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace cinrt::model
+{
+  // What to do when a task is posted to a full queue.
+  enum class QueuePolicy
+  {
+    Reject,     // refuse the new task
+    Block,      // wait until a slot frees up
+    DropOldest  // discard the oldest queued task, its future gets broken_promise
+  };
+
+  // Fixed-size worker pool fed by a bounded MPMC queue.
+  class Executor
+  {
+  protected:
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _queue;
+    size_t _capacity;
+    QueuePolicy _policy;
+    std::mutex _mutex;
+    std::condition_variable _notEmpty;
+    std::condition_variable _notFull;
+    bool _stop = false;
+
+    void loop();
+
+  public:
+    // workers = 0 uses the number of hardware threads.
+    Executor(size_t workers = 0, size_t capacity = 1024, QueuePolicy policy = QueuePolicy::Block);
+    ~Executor();
+    // Returns false when the task was rejected.
+    bool post(std::function<void()> task);
+    // Throws when the task was rejected.
+    template <class F>
+    std::future<std::invoke_result_t<F>> submit(F&& task) {
+      using R = std::invoke_result_t<F>;
+      auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+      std::future<R> result = packaged->get_future();
+      if (!post([packaged]{ (*packaged)(); }))
+        throw std::runtime_error("Executor queue is full");
+      return result;
+    }
+    size_t pending();
+    size_t workers() const { return _workers.size(); }
+    // Process-wide default executor.
+    static std::shared_ptr<Executor> shared();
+    // Process-wide executor for sessions whose runs each use intraThreads
+    // ORT threads (<= 0 means all cores), with as many workers as such runs
+    // fit on the cores.
+    static std::shared_ptr<Executor> forSessions(int intraThreads);
+  };
+};
+
+#endif // __CRT_EXECUTOR_H__
@@ -0,0 +1,91 @@
+#ifndef __CRT_FRAME_STREAM_H__
+#define __CRT_FRAME_STREAM_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "postprocess.h"
+#include "preprocess.h"
+
+namespace cinrt::model
+{
+  class Model;
+
+  struct FrameDeltaOptions
+  {
+    // Frames are compared as grayscale thumbnails of cell x cell blocks.
+    int cell = 8;
+    // Mean absolute thumbnail difference, 0 to 255, under which the
+    // outputs of the last inferred frame are reused.
+    float threshold = 2.f;
+    // Inference at least once every refreshEvery frames, 0 never forces it.
+    int refreshEvery = 30;
+    // Also reuse outputs when the frame matches the inferred one shifted by
+    // up to maxShift cells, the shift is then reported to be applied.
+    bool motionShift = true;
+    int maxShift = 4;
+    // Model input size, defaults to the fixed dims of the first input.
+    int width = 0;
+    int height = 0;
+    bool letterbox = true;
+    PreprocessOptions preprocess;
+  };
+
+  struct FrameResult
+  {
+    // Outputs of the last inferred frame, shared by the frames reusing them.
+    std::shared_ptr<std::vector<Ort::Value>> outputs;
+    // Maps output coordinates back to the frame, see rescale.
+    Rescale scale;
+    bool inferred = false;
+    // Motion of the frame since the inferred one in frame pixels, see translate.
+    int shiftX = 0;
+    int shiftY = 0;
+    // Mean absolute thumbnail difference to the inferred frame, after the shift.
+    float difference = 0.f;
+  };
+
+  // Runs a video stream through a batch-1 image model, skipping inference
+  // for frames close to the last inferred one. Not thread safe, use one
+  // stream per camera. Streams may share a model, which must outlive them.
+  class FrameStream
+  {
+  protected:
+    Model* _model;
+    FrameDeltaOptions _options;
+    std::vector<std::string> _inputNames;
+    // The input tensor, refilled for every inferred frame.
+    std::vector<Ort::Value> _inputs;
+    uint32_t (*_sad)(const uint8_t* a, const uint8_t* b, int size) = nullptr;
+    std::vector<uint8_t> _thumbnail;
+    // Thumbnail of the last inferred frame.
+    std::vector<uint8_t> _reference;
+    int _thumbWidth = 0;
+    int _thumbHeight = 0;
+    int _frameWidth = 0;
+    int _frameHeight = 0;
+    int _sinceRefresh = 0;
+    FrameResult _last;
+    uint64_t _frames = 0;
+    uint64_t _inferences = 0;
+
+    void downsample(const ImageView& frame);
+    // Mean absolute difference of the thumbnail to the reference shifted
+    // by dx, dy cells, over their overlap.
+    float difference(int dx, int dy) const;
+    FrameResult infer(const ImageView& frame, const Ort::RunOptions& runOptions);
+
+  public:
+    FrameStream(Model* model, const FrameDeltaOptions& options = FrameDeltaOptions());
+    // Frames are 3-channel, see ImageView.
+    FrameResult next(const ImageView& frame, const Ort::RunOptions& runOptions = Ort::RunOptions());
+    // The next frame is inferred.
+    void reset();
+    uint64_t frames() const { return _frames; }
+    uint64_t inferences() const { return _inferences; }
+  };
+};
+
+#endif // __CRT_FRAME_STREAM_H__
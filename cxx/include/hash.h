@@ -0,0 +1,16 @@
+#ifndef __CRT_HASH_H__
+#define __CRT_HASH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cinrt::model
+{
+  // XXH64 of a byte range. Chain calls through seed to hash several ranges.
+  uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+  // Chained hash64 of a whole file, read in fixed-size chunks.
+  uint64_t hashFile(const std::string& path);
+};
+
+#endif // __CRT_HASH_H__
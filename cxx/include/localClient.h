@@ -0,0 +1,54 @@
+#ifndef __CRT_LOCAL_CLIENT_H__
+#define __CRT_LOCAL_CLIENT_H__
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "sharedMemory.h"
+
+namespace cinrt::model
+{
+  // Runs models served by a LocalServer with the Model::run signatures.
+  // One request at a time per client, use a client per thread for more.
+  class LocalClient
+  {
+  protected:
+    int _socket = -1;
+    std::unique_ptr<SharedRegion> _region;
+    SharedRing _requests;
+    SharedRing _responses;
+    std::mutex _mutex;
+    Ort::AllocatorWithDefaultOptions _allocator;
+
+    std::shared_ptr<std::vector<Ort::Value>> call(WireMessage& request);
+    void putInputs(
+      WireMessage& request,
+      const std::vector<std::string>& inputNames,
+      const std::vector<const Ort::Value*>& inputs);
+
+  public:
+    // ringBytes bounds the input bytes of a request and the output bytes
+    // of its reply.
+    LocalClient(const std::string& path, size_t ringBytes = size_t(64) << 20);
+    ~LocalClient();
+    LocalClient(const LocalClient&) = delete;
+    LocalClient& operator=(const LocalClient&) = delete;
+
+    // Same results as Model::run on the served model: null when the run
+    // failed, throws when the server is gone or rejects the request.
+    // Outputs are owned by the client process.
+    std::shared_ptr<std::vector<Ort::Value>> run(
+      const std::string& model,
+      const Ort::Value& inputs,
+      std::shared_ptr<const char*> outputHead = nullptr);
+    std::shared_ptr<std::vector<Ort::Value>> run(
+      const std::string& model,
+      const std::vector<std::string>& inputNames,
+      const std::vector<Ort::Value>& inputs,
+      const std::vector<std::string>& outputNames = {});
+  };
+};
+
+#endif // __CRT_LOCAL_CLIENT_H__
@@ -0,0 +1,58 @@
+#ifndef __CRT_LOCAL_SERVER_H__
+#define __CRT_LOCAL_SERVER_H__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <onnxruntime_cxx_api.h>
+#include "sharedMemory.h"
+
+namespace cinrt::model
+{
+  class modelManager;
+
+  // Serves the models of a manager to other processes on the host over a
+  // Unix domain socket, see LocalClient. Every client maps a shared region
+  // of its own: inputs are read in place from its request ring and outputs
+  // copied once into its response ring, only names and shapes go through
+  // the socket. Requests run on the replica pickReplica routes to, through
+  // the model batcher for single-input runs when batching is enabled.
+  class LocalServer
+  {
+  protected:
+    struct Connection
+    {
+      int socket;
+      std::thread thread;
+      std::atomic<bool> done{false};
+    };
+
+    modelManager& _manager;
+    std::string _path;
+    int _socket = -1;
+    std::atomic<bool> _stop{false};
+    std::mutex _mutex;
+    std::list<Connection> _connections;
+    Ort::MemoryInfo _memoryInfo;
+    std::thread _thread;
+
+    void loop();
+    void serve(Connection& connection);
+    // Runs one request, answers with the reply to send.
+    void handle(WireMessage& request, WireMessage& reply, SharedRing& requests, SharedRing& responses);
+    // Joins the connections that ended.
+    void reap();
+
+  public:
+    // The manager must outlive the server, models are looked up by the
+    // names they were created under.
+    LocalServer(modelManager& manager, const std::string& path);
+    ~LocalServer();
+    size_t connections();
+  };
+};
+
+#endif // __CRT_LOCAL_SERVER_H__
@@ -0,0 +1,29 @@
+#ifndef __CRT_MAPPED_FILE_H__
+#define __CRT_MAPPED_FILE_H__
+
+#include <string>
+#include <vector>
+
+namespace cinrt::model
+{
+  // Read-only memory mapping of a whole file. Mappings of the same file
+  // share the page cache, so the bytes are resident once per host.
+  // Platforms without mmap fall back to reading the file.
+  class MappedFile
+  {
+  protected:
+    void* _data = nullptr;
+    size_t _size = 0;
+    std::vector<char> _buffer;
+
+  public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const void* data() const { return _data; }
+    size_t size() const { return _size; }
+  };
+};
+
+#endif // __CRT_MAPPED_FILE_H__
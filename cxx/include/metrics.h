@@ -0,0 +1,134 @@
+#ifndef __CRT_METRICS_H__
+#define __CRT_METRICS_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cinrt::model
+{
+  // Monotonic counter striped over cache lines, so threads recording at
+  // the same time do not bounce a shared line. Reads sum the stripes.
+  class Counter
+  {
+  protected:
+    static constexpr size_t STRIPES = 16;
+    struct alignas(64) Cell
+    {
+      std::atomic<uint64_t> value{0};
+    };
+    Cell _cells[STRIPES];
+
+  public:
+    void add(uint64_t count = 1);
+    uint64_t value() const;
+  };
+
+  struct HistogramSnapshot
+  {
+    std::vector<uint64_t> counts;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    // Upper bound of the bucket holding quantile q in [0, 1], 0 when empty.
+    uint64_t percentile(double q) const;
+    double mean() const { return count ? static_cast<double>(sum) / count : 0.0; }
+  };
+
+  // Log-linear buckets as in HdrHistogram: 32 linear sub-buckets per power
+  // of two, so a value is reported within ~3% for up to 2^40 units.
+  // record() is a relaxed increment on a per-thread stripe, no lock.
+  class Histogram
+  {
+  public:
+    static constexpr int SUB_BITS = 5;
+    static constexpr int MAX_BITS = 40;
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    static size_t bucket(uint64_t value);
+    static uint64_t upperBound(size_t bucket);
+
+  protected:
+    static constexpr size_t STRIPES = 4;
+    struct alignas(64) Stripe
+    {
+      std::atomic<uint64_t> counts[BUCKETS];
+      std::atomic<uint64_t> sum;
+    };
+    std::unique_ptr<Stripe[]> _stripes;
+
+  public:
+    Histogram();
+    void record(uint64_t value);
+    HistogramSnapshot snapshot() const;
+  };
+
+  // Shared by every replica of a model name and kept across reloads.
+  // Histograms are in nanoseconds.
+  struct ModelMetrics
+  {
+    Counter requests;
+    Counter failures;
+    Histogram latency;
+    Histogram queueWait;
+    Counter loads;
+    Counter unloads;
+    Counter evictions;
+    // Scheduled requests dropped in the queue or stopped at their deadline.
+    Counter expired;
+    Counter cacheHits;
+    Counter cacheMisses;
+    // Stream frames answered with the outputs of an earlier frame.
+    Counter skippedFrames;
+    Histogram loadTime;
+    Histogram unloadTime;
+  };
+
+  struct ModelStats
+  {
+    std::string model;
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+    uint64_t loads = 0;
+    uint64_t unloads = 0;
+    uint64_t evictions = 0;
+    uint64_t expired = 0;
+    uint64_t cacheHits = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t skippedFrames = 0;
+    size_t replicas = 0;
+    int inflight = 0;
+    HistogramSnapshot latency;
+    HistogramSnapshot queueWait;
+    HistogramSnapshot loadTime;
+    HistogramSnapshot unloadTime;
+  };
+
+  // Prometheus text exposition format.
+  std::string toPrometheus(const std::vector<ModelStats>& stats);
+
+  // Serves render() to every client of a Unix domain socket, wrapped in an
+  // HTTP response when the client sent a GET request.
+  class MetricsEndpoint
+  {
+  protected:
+    std::string _path;
+    std::function<std::string()> _render;
+    int _socket = -1;
+    std::atomic<bool> _stop{false};
+    std::thread _thread;
+
+    void loop();
+
+  public:
+    MetricsEndpoint(const std::string& path, std::function<std::string()> render);
+    ~MetricsEndpoint();
+  };
+};
+
+#endif // __CRT_METRICS_H__
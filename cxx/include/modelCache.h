@@ -0,0 +1,39 @@
+#ifndef __CRT_MODEL_CACHE_H__
+#define __CRT_MODEL_CACHE_H__
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace cinrt::model
+{
+  // Directory of graph-optimized models saved in ORT format. Entries are
+  // keyed by the model file hash, the ORT version and the session options
+  // that change the optimized graph.
+  class ModelCache
+  {
+  protected:
+    struct FileHash
+    {
+      int64_t size;
+      int64_t mtime;
+      uint64_t hash;
+    };
+
+    std::string _dir;
+    // Avoids rehashing unchanged files on every reload.
+    std::map<std::string, FileHash> _hashes;
+    std::mutex _mutex;
+
+    uint64_t fileHash(const std::string& model);
+
+  public:
+    ModelCache(std::string dir);
+    // Cached copy of model for these options, it may not exist yet.
+    std::string path(const std::string& model, bool parallel, int graphOpLevel);
+    const std::string& dir() const { return _dir; }
+  };
+};
+
+#endif // __CRT_MODEL_CACHE_H__
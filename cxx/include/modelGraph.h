@@ -0,0 +1,176 @@
+#ifndef __CRT_MODEL_GRAPH_H__
+#define __CRT_MODEL_GRAPH_H__
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "bufferPool.h"
+#include "postprocess.h"
+#include "preprocess.h"
+
+namespace cinrt::model
+{
+  class modelManager;
+  class Executor;
+
+  // Named values of one ModelGraph run: the graph inputs set by the caller,
+  // then what every node produces. A value is written once, nodes running
+  // in parallel read and write values concurrently.
+  class GraphValues
+  {
+  protected:
+    enum class Kind
+    {
+      Tensor,
+      Image,
+      Detections
+    };
+
+    struct Slot
+    {
+      Kind kind = Kind::Tensor;
+      const Ort::Value* tensor = nullptr;
+      // Keeps the tensor memory alive: a run result, a pooled buffer or the value.
+      std::shared_ptr<void> owner;
+      ImageView image;
+      std::shared_ptr<const Detections> detections;
+    };
+
+    mutable std::mutex _mutex;
+    std::map<std::string, Slot> _slots;
+    std::map<std::string, std::vector<Rescale>> _scales;
+
+    const Slot& find(const std::string& name, Kind kind) const;
+    void insert(const std::string& name, Slot slot);
+
+  public:
+    bool has(const std::string& name) const;
+    // Throw when the value is missing or of another kind.
+    const Ort::Value& tensor(const std::string& name) const;
+    const ImageView& image(const std::string& name) const;
+    const Detections& detections(const std::string& name) const;
+    // Per-row mapping of a crops tensor back to the image, see addCrops.
+    const std::vector<Rescale>& scales(const std::string& name) const;
+
+    void setTensor(const std::string& name, Ort::Value value);
+    void setTensor(const std::string& name, BufferPool::Tensor tensor);
+    // Output index of a run result, held in place with the result.
+    void setTensor(const std::string& name, std::shared_ptr<std::vector<Ort::Value>> outputs, size_t index);
+    // The pixels are not copied, they must outlive the run.
+    void setImage(const std::string& name, const ImageView& image);
+    void setDetections(const std::string& name, Detections detections);
+    void setScales(const std::string& name, std::vector<Rescale> scales);
+  };
+
+  struct CropOptions
+  {
+    // Input size of the model the crops feed.
+    int width = 112;
+    int height = 112;
+    // Boxes grow by margin times their size on every side before cropping.
+    float margin = 0.f;
+    bool letterbox = false;
+    // Crops of the first maxCrops boxes only, 0 keeps all. Boxes out of
+    // nms are sorted by decreasing score.
+    size_t maxCrops = 0;
+    PreprocessOptions preprocess;
+  };
+
+  // Reads and writes the values it was declared with.
+  using GraphFunction = std::function<void(GraphValues& values)>;
+
+  // Declarative DAG over the models of a modelManager. Nodes are wired by
+  // value names: a node runs once the values it reads are written, nodes
+  // that do not depend on each other run in parallel on the executor and
+  // the calling thread. A node whose inputs were not produced is skipped,
+  // along with everything downstream, e.g. crops of an image without
+  // detections. Model inputs are views of the values they read and model
+  // outputs are kept in place, pooled when the manager has a buffer pool.
+  // Build the graph before running it, runs may then be concurrent.
+  class ModelGraph
+  {
+  protected:
+    enum class NodeKind
+    {
+      Model,
+      Crops,
+      Function
+    };
+
+    struct Node
+    {
+      std::string name;
+      NodeKind kind = NodeKind::Model;
+      // Values read and written.
+      std::vector<std::string> inputs;
+      std::vector<std::string> outputs;
+      std::string model;
+      // Model tensor names, in the order of inputs and outputs.
+      std::vector<std::string> modelInputs;
+      std::vector<std::string> modelOutputs;
+      CropOptions crop;
+      GraphFunction function;
+      std::vector<size_t> dependents;
+      size_t dependencies = 0;
+    };
+
+    struct RunState;
+
+    modelManager& _manager;
+    std::shared_ptr<Executor> _executor;
+    Ort::MemoryInfo _memoryInfo;
+    std::vector<Node> _nodes;
+    // Node writing each value.
+    std::map<std::string, size_t> _producers;
+
+    void add(Node node);
+    // Runs a ready node on this thread, false when none is ready.
+    bool step(const std::shared_ptr<RunState>& state, GraphValues& values) const;
+    void runNode(const Node& node, GraphValues& values) const;
+    void runModel(const Node& node, GraphValues& values) const;
+    void runCrops(const Node& node, GraphValues& values) const;
+
+  public:
+    // Defaults to Executor::shared().
+    ModelGraph(modelManager& manager, std::shared_ptr<Executor> executor = nullptr);
+
+    // Runs a model of the manager. inputs maps model inputs to the values
+    // they read, outputs maps the model outputs to fetch to the values they
+    // write. Unmapped inputs read the value of their own name, and every
+    // output is fetched under its own name when outputs is empty. The model
+    // must be loaded.
+    ModelGraph& addModel(
+      const std::string& node,
+      const std::string& model,
+      const std::map<std::string, std::string>& inputs = {},
+      const std::map<std::string, std::string>& outputs = {});
+    // Fan-out: resizes every box of detections, in image pixels, out of
+    // image into one {N, 3, height, width} float tensor, so the model
+    // reading output runs once for all crops. scales(output) maps each
+    // row back to the image. Nothing is written without boxes.
+    ModelGraph& addCrops(
+      const std::string& node,
+      const std::string& image,
+      const std::string& detections,
+      const std::string& output,
+      const CropOptions& options = CropOptions());
+    // Any other step, e.g. decoding detections out of a detector output.
+    ModelGraph& addFunction(
+      const std::string& node,
+      const std::vector<std::string>& inputs,
+      const std::vector<std::string>& outputs,
+      GraphFunction function);
+
+    // Values read but written by no node, values must hold them before run.
+    std::vector<std::string> inputs() const;
+    // Runs every node once. Throws the first node failure once the nodes
+    // already running return, the nodes not started are dropped.
+    void run(GraphValues& values) const;
+  };
+};
+
+#endif // __CRT_MODEL_GRAPH_H__
@@ -0,0 +1,231 @@
+#ifndef __CRT_PIPELINE_H__
+#define __CRT_PIPELINE_H__
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "core.h"
+#include "ringBuffer.h"
+
+namespace cinrt::model
+{
+  struct PipelineOptions
+  {
+    size_t preprocessWorkers = 1;
+    size_t inferWorkers = 1;
+    size_t postprocessWorkers = 1;
+    // Slots of the ring buffer in front of each stage.
+    size_t capacity = 8;
+    // Frames pushed and not yet popped, push blocks beyond it.
+    size_t maxInflight = 8;
+  };
+
+  enum class PipelineStage
+  {
+    Preprocess,
+    Infer,
+    Postprocess,
+    Output
+  };
+
+  // Runs preprocess -> Model::run -> postprocess on a stream of frames,
+  // each stage on its own workers, linked by lock-free ring buffers, so
+  // frame N + 1 is preprocessed while frame N is inferring.
+  // Results come out of pop() in push order. push() and pop() are meant
+  // for one producer and one consumer thread.
+  template <typename Input, typename Output>
+  class Pipeline
+  {
+  public:
+    // Returns the model inputs, in the order of Model::getInputs().
+    using Preprocess = std::function<std::vector<Ort::Value>(const Input&)>;
+    using Postprocess = std::function<Output(const Input&, std::vector<Ort::Value>&)>;
+
+  protected:
+    struct Item
+    {
+      uint64_t sequence;
+      Input input;
+      std::vector<Ort::Value> tensors;
+      // Kept whole, pooled outputs return to the pool with it.
+      std::shared_ptr<std::vector<Ort::Value>> outputs;
+      Output output;
+      std::exception_ptr error;
+    };
+
+    static constexpr int STAGES = 3;
+
+    std::shared_ptr<Model> _model;
+    Preprocess _preprocess;
+    Postprocess _postprocess;
+    PipelineOptions _options;
+    std::vector<std::string> _inputNames;
+    // _queues[s] feeds stage s, the last one feeds pop().
+    std::vector<std::unique_ptr<RingBuffer<Item*>>> _queues;
+    // Set once nothing more will be pushed to the queue.
+    std::unique_ptr<std::atomic<bool>[]> _closed;
+    std::unique_ptr<std::atomic<int>[]> _active;
+    std::atomic<bool> _stop{false};
+    std::atomic<uint64_t> _sequence{0};
+    std::atomic<size_t> _inflight{0};
+    std::atomic<size_t> _peakInflight{0};
+    uint64_t _nextOutput = 0;
+    std::map<uint64_t, Item*> _reorder;
+    std::vector<std::thread> _workers;
+
+    bool enqueue(RingBuffer<Item*>& queue, Item* item) {
+      Backoff backoff;
+      while (!queue.tryPush(item)) {
+        if (_stop.load(std::memory_order_relaxed))
+          return false;
+        backoff.pause();
+      }
+      return true;
+    }
+
+    // False once the queue is closed and drained, or on stop.
+    bool dequeue(int index, Item*& item) {
+      Backoff backoff;
+      while (true) {
+        bool closed = _closed[index].load(std::memory_order_acquire);
+        if (_queues[index]->tryPop(item))
+          return true;
+        if (closed || _stop.load(std::memory_order_relaxed))
+          return false;
+        backoff.pause();
+      }
+    }
+
+    void process(int stage, Item* item) {
+      if (stage == 0) {
+        item->tensors = _preprocess(item->input);
+      } else if (stage == 1) {
+        item->outputs = _model->run(_inputNames, item->tensors);
+        if (item->outputs == nullptr)
+          throw std::runtime_error("Inference failed");
+        item->tensors.clear();
+      } else {
+        item->output = _postprocess(item->input, *item->outputs);
+        item->outputs.reset();
+      }
+    }
+
+    void work(int stage) {
+      Item* item;
+      while (dequeue(stage, item)) {
+        // A failed frame skips the remaining stages and throws from pop().
+        if (!item->error) {
+          try {
+            process(stage, item);
+          } catch (...) {
+            item->error = std::current_exception();
+          }
+        }
+        if (!enqueue(*_queues[stage + 1], item))
+          delete item;
+      }
+      if (_active[stage].fetch_sub(1) == 1)
+        _closed[stage + 1].store(true, std::memory_order_release);
+    }
+
+  public:
+    Pipeline(std::shared_ptr<Model> model, Preprocess preprocess, Postprocess postprocess, PipelineOptions options = PipelineOptions())
+      : _model(model), _preprocess(preprocess), _postprocess(postprocess), _options(options),
+        _closed(new std::atomic<bool>[STAGES + 1]), _active(new std::atomic<int>[STAGES]) {
+      if (_options.maxInflight == 0)
+        _options.maxInflight = 1;
+      for (const TensorInfo& input : _model->getInputs())
+        _inputNames.push_back(input.name);
+      for (int i = 0; i <= STAGES; ++i) {
+        _queues.emplace_back(new RingBuffer<Item*>(_options.capacity));
+        _closed[i].store(false);
+      }
+      size_t workers[STAGES] = {_options.preprocessWorkers, _options.inferWorkers, _options.postprocessWorkers};
+      for (int stage = 0; stage < STAGES; ++stage) {
+        workers[stage] = std::max<size_t>(1, workers[stage]);
+        _active[stage].store(static_cast<int>(workers[stage]));
+        for (size_t i = 0; i < workers[stage]; ++i)
+          _workers.emplace_back(&Pipeline::work, this, stage);
+      }
+    }
+
+    // Frames still in flight are dropped.
+    ~Pipeline() {
+      close();
+      _stop.store(true);
+      for (std::thread& worker : _workers)
+        worker.join();
+      Item* item;
+      for (auto& queue : _queues)
+        while (queue->tryPop(item))
+          delete item;
+      for (auto& entry : _reorder)
+        delete entry.second;
+    }
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Blocks while maxInflight frames are pending, false after close().
+    bool push(Input input) {
+      if (_closed[0].load(std::memory_order_relaxed))
+        return false;
+      Backoff backoff;
+      while (_inflight.load(std::memory_order_acquire) >= _options.maxInflight) {
+        if (_stop.load(std::memory_order_relaxed))
+          return false;
+        backoff.pause();
+      }
+      size_t inflight = _inflight.fetch_add(1) + 1;
+      size_t peak = _peakInflight.load(std::memory_order_relaxed);
+      while (inflight > peak && !_peakInflight.compare_exchange_weak(peak, inflight)) {}
+      Item* item = new Item{_sequence.fetch_add(1), std::move(input), {}, nullptr, Output(), nullptr};
+      if (!enqueue(*_queues[0], item)) {
+        delete item;
+        _inflight.fetch_sub(1);
+        return false;
+      }
+      return true;
+    }
+
+    // Next result in push order, false once closed and drained.
+    // Rethrows what a stage threw for that frame.
+    bool pop(Output& output) {
+      while (true) {
+        auto it = _reorder.find(_nextOutput);
+        if (it != _reorder.end()) {
+          std::unique_ptr<Item> item(it->second);
+          _reorder.erase(it);
+          ++_nextOutput;
+          _inflight.fetch_sub(1, std::memory_order_release);
+          if (item->error)
+            std::rethrow_exception(item->error);
+          output = std::move(item->output);
+          return true;
+        }
+        Item* item;
+        if (!dequeue(STAGES, item))
+          return false;
+        _reorder.emplace(item->sequence, item);
+      }
+    }
+
+    // No more frames, pop() returns false after the last result.
+    void close() { _closed[0].store(true, std::memory_order_release); }
+
+    size_t inflight() const { return _inflight.load(std::memory_order_relaxed); }
+    size_t peakInflight() const { return _peakInflight.load(std::memory_order_relaxed); }
+    // Frames waiting in front of stage.
+    size_t queued(PipelineStage stage) const { return _queues[static_cast<int>(stage)]->size(); }
+  };
+};
+
+#endif // __CRT_PIPELINE_H__
@@ -0,0 +1,75 @@
+#ifndef __CRT_POSTPROCESS_H__
+#define __CRT_POSTPROCESS_H__
+
+#include <cstddef>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "preprocess.h"
+
+namespace cinrt::model
+{
+  // Boxes of one image in structure-of-arrays form, corners in pixels.
+  // keypoints holds numKeypoints (x, y, confidence) triplets per box.
+  struct Detections
+  {
+    std::vector<float> x0, y0, x1, y1, score;
+    std::vector<int> cls;
+    std::vector<float> keypoints;
+    int numKeypoints = 0;
+
+    size_t size() const { return score.size(); }
+    void clear();
+    void reserve(size_t count);
+  };
+
+  // Maps model input coordinates back to the original image:
+  // original = (input - pad) / scale, clipped to width x height when set.
+  struct Rescale
+  {
+    float scaleX = 1.f;
+    float scaleY = 1.f;
+    float padX = 0.f;
+    float padY = 0.f;
+    float width = 0.f;
+    float height = 0.f;
+
+    // Plain resize from originalWidth x originalHeight to the input size.
+    static Rescale stretch(int inputWidth, int inputHeight, int originalWidth, int originalHeight);
+    // Undoes letterboxToTensor of an originalWidth x originalHeight image.
+    static Rescale letterbox(const Letterbox& box, int originalWidth, int originalHeight);
+  };
+
+  struct PostprocessOptions
+  {
+    float scoreThreshold = 0.25f;
+    // NMS is skipped when 1 or above, e.g. for exports with NMS built in.
+    float iouThreshold = 0.45f;
+    bool classAgnostic = false;
+    size_t maxDetections = 300;
+    // Keypoints per box in raw heads, rows infer them from their width.
+    int numKeypoints = 0;
+  };
+
+  // Suppresses boxes overlapping a higher scoring box of the same class.
+  // Keeps at most maxDetections, sorted by decreasing score.
+  void nms(Detections& detections, float iouThreshold, bool classAgnostic = false, size_t maxDetections = 300);
+  void rescale(Detections& detections, const Rescale& scale);
+  // Moves boxes and keypoints by dx, dy pixels, e.g. the motion of a
+  // FrameResult.
+  void translate(Detections& detections, float dx, float dy);
+
+  // End-to-end exports, {N, 7 + 3 * keypoints} rows of
+  // [batch, x0, y0, x1, y1, class, score, keypoints...].
+  std::vector<Detections> decodeRows(const float* data, size_t rows, size_t cols, size_t batchSize,
+    const PostprocessOptions& options = PostprocessOptions(), const std::vector<Rescale>& scales = {});
+  std::vector<Detections> decodeRows(const Ort::Value& output, size_t batchSize,
+    const PostprocessOptions& options = PostprocessOptions(), const std::vector<Rescale>& scales = {});
+  // Raw heads, {batch, anchors, 5 + classes + 3 * keypoints} of
+  // [cx, cy, w, h, objectness, class scores..., keypoints...].
+  std::vector<Detections> decodeHead(const float* data, size_t batchSize, size_t anchors, size_t cols,
+    const PostprocessOptions& options = PostprocessOptions(), const std::vector<Rescale>& scales = {});
+  std::vector<Detections> decodeHead(const Ort::Value& output,
+    const PostprocessOptions& options = PostprocessOptions(), const std::vector<Rescale>& scales = {});
+};
+
+#endif // __CRT_POSTPROCESS_H__
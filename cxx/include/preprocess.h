@@ -0,0 +1,67 @@
+#ifndef __CRT_PREPROCESS_H__
+#define __CRT_PREPROCESS_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cinrt::model
+{
+  // Interleaved 8-bit image, e.g. the data of a CV_8UC3 cv::Mat.
+  // stride is the byte distance between rows, 0 means tightly packed.
+  struct ImageView
+  {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;
+  };
+
+  enum class SimdLevel
+  {
+    Scalar,
+    SSE41,
+    AVX2,
+    AVX512
+  };
+
+  // Per output channel (RGB order when swapRB is set): value / 255 then
+  // (value - mean) / std. The defaults give plain [0, 1] scaling.
+  struct PreprocessOptions
+  {
+    bool swapRB = true;
+    float mean[3] = {0.f, 0.f, 0.f};
+    float std[3] = {1.f, 1.f, 1.f};
+    // Highest instruction set to use, capped by what the CPU supports.
+    SimdLevel simd = SimdLevel::AVX512;
+  };
+
+  // Aspect-preserving placement of an image inside a tensor: resized to
+  // width x height at scale, then offset by padX, padY.
+  struct Letterbox
+  {
+    float scale = 1.f;
+    int width = 0;
+    int height = 0;
+    int padX = 0;
+    int padY = 0;
+
+    // Largest fit centered in a width x height tensor. Without upscale,
+    // images that already fit are only padded.
+    static Letterbox fit(int imageWidth, int imageHeight, int width, int height, bool upscale = true);
+  };
+
+  SimdLevel detectSimd();
+  // Bilinear resize to width x height, channel swap, HWC uint8 to CHW
+  // float and normalization in a single pass over 3-channel src into dst.
+  void imageToTensor(const ImageView& src, float* dst, int width, int height, const PreprocessOptions& options = PreprocessOptions());
+  // Same as imageToTensor into the box, the border is set to padValue
+  // (114 is the YOLO letterbox gray) before normalization.
+  void letterboxToTensor(const ImageView& src, float* dst, int width, int height, const Letterbox& box,
+    const PreprocessOptions& options = PreprocessOptions(), uint8_t padValue = 114);
+  // Writes each image as 3 consecutive planes, which is both the channel
+  // stacking of {1, 3 * n, h, w} inputs and the batch layout of {n, 3, h, w}.
+  void imagesToTensor(const std::vector<ImageView>& images, float* dst, int width, int height, const PreprocessOptions& options = PreprocessOptions());
+};
+
+#endif // __CRT_PREPROCESS_H__
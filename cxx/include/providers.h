@@ -0,0 +1,42 @@
+#ifndef __CRT_PROVIDERS_H__
+#define __CRT_PROVIDERS_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+namespace cinrt::model
+{
+  // Execution provider to try, by short name ("XNNPACK", "DNNL" or
+  // "oneDNN", "CPU") or by ORT name ("XnnpackExecutionProvider"). Options
+  // are handed to the provider as is, e.g. {"intra_op_num_threads", "4"}
+  // for XNNPACK or {"use_arena", "1"} for DNNL.
+  struct ExecutionProvider
+  {
+    std::string name;
+    std::map<std::string, std::string> options;
+  };
+
+  // Node of the optimized graph and the provider that ran it.
+  struct NodePlacement
+  {
+    std::string node;
+    std::string op;
+    std::string provider;
+  };
+
+  // ORT name of a provider, empty when it is not supported here.
+  std::string providerName(const std::string& name);
+  // Providers compiled into the linked ORT build.
+  std::vector<std::string> availableProviders();
+  // Appends providers in order of preference. Providers missing from the
+  // build or failing to initialize are reported and skipped, the CPU
+  // provider always takes the nodes left over. Returns the ORT names of the
+  // providers applied, CPU last.
+  std::vector<std::string> appendProviders(Ort::SessionOptions& options, const std::vector<ExecutionProvider>& providers);
+  // Nodes run in an ORT profiling trace, once each, in trace order.
+  std::vector<NodePlacement> readPlacement(const std::string& trace);
+};
+
+#endif // __CRT_PROVIDERS_H__
@@ -0,0 +1,69 @@
+#ifndef __CRT_REGISTRY_H__
+#define __CRT_REGISTRY_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cinrt::model
+{
+  class Model;
+
+  // Read-optimized map from model name to its session replicas.
+  // Readers look up an immutable snapshot without taking any lock: they
+  // only bump a striped reader counter, and retry only when a writer
+  // publishes at the same instant. Writers copy the snapshot, swap it in
+  // atomically and free the old one after a grace period in which every
+  // reader that could still see it has left.
+  class ModelRegistry
+  {
+  public:
+    using Replicas = std::vector<std::shared_ptr<Model>>;
+
+  protected:
+    using Snapshot = std::unordered_map<std::string, std::shared_ptr<const Replicas>>;
+    static constexpr size_t STRIPES = 16;
+
+    struct alignas(64) ReaderCount
+    {
+      std::atomic<int64_t> value{0};
+    };
+
+    mutable ReaderCount _readers[2][STRIPES];
+    std::atomic<uint64_t> _epoch{0};
+    std::atomic<const Snapshot*> _current;
+    std::mutex _writer;
+
+    std::atomic<int64_t>& enter() const;
+    // Waits until no reader can still hold the previous snapshot.
+    void synchronize();
+    // Maps name to replicas, or removes it when null, and returns the previous value.
+    std::shared_ptr<const Replicas> replace(const std::string& name, std::shared_ptr<const Replicas> replicas);
+    // Same with _writer held.
+    std::shared_ptr<const Replicas> replaceLocked(const std::string& name, std::shared_ptr<const Replicas> replicas);
+
+  public:
+    ModelRegistry();
+    ~ModelRegistry();
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+    std::shared_ptr<const Replicas> find(const std::string& name) const;
+    // Inserts or atomically replaces, readers see either version in full.
+    std::shared_ptr<const Replicas> publish(const std::string& name, Replicas replicas);
+    std::shared_ptr<const Replicas> remove(const std::string& name);
+    // Removes name in one writer step if evictable accepts its replicas once
+    // no reader can find them anymore, the caller then holds the only
+    // reference to the list. Otherwise the entry is put back and null is
+    // returned, readers may have missed it meanwhile.
+    std::shared_ptr<const Replicas> removeIf(
+      const std::string& name, const std::function<bool(const std::shared_ptr<const Replicas>&)>& evictable);
+    std::vector<std::string> names() const;
+    void clear();
+  };
+};
+
+#endif // __CRT_REGISTRY_H__
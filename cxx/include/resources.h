@@ -0,0 +1,15 @@
+#ifndef __CRT_RESOURCES_H__
+#define __CRT_RESOURCES_H__
+
+#include <cstddef>
+#include <string>
+
+namespace cinrt::model
+{
+  // Resident set size of this process, 0 where it cannot be read.
+  size_t residentBytes();
+  // Suffix of a temporary file unique across threads and processes.
+  std::string uniqueSuffix();
+};
+
+#endif // __CRT_RESOURCES_H__
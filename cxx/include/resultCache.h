@@ -0,0 +1,85 @@
+#ifndef __CRT_RESULT_CACHE_H__
+#define __CRT_RESULT_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "metrics.h"
+
+namespace cinrt::model
+{
+  struct ResultCacheStats
+  {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    // Output bytes held.
+    size_t bytes = 0;
+  };
+
+  // Identifies a run: the input names, types and shapes and the outputs
+  // requested are kept verbatim, the input bytes as two seeded hashes.
+  struct ResultKey
+  {
+    uint64_t hash = 0;
+    uint64_t check = 0;
+    std::string layout;
+    bool operator==(const ResultKey& other) const {
+      return hash == other.hash && check == other.check && layout == other.layout;
+    }
+  };
+
+  // Outputs of past runs by ResultKey, looked up by its hash and verified
+  // in full on a hit. Bounded by output bytes, the least recently used
+  // results go first. Entries are copies, and hits hand out new copies, so
+  // callers may write to their outputs.
+  class ResultCache
+  {
+  protected:
+    struct Entry
+    {
+      ResultKey key;
+      std::shared_ptr<const std::vector<Ort::Value>> outputs;
+      size_t bytes;
+    };
+
+    size_t _maxBytes;
+    size_t _bytes = 0;
+    // Most recently used first.
+    std::list<Entry> _entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _index;
+    mutable std::mutex _mutex;
+    Ort::AllocatorWithDefaultOptions _allocator;
+    Counter _hits;
+    Counter _misses;
+    Counter _evictions;
+
+  public:
+    ResultCache(size_t maxBytes = size_t(256) << 20);
+
+    // False when an input is not a dense tensor, the run is then not cached.
+    static bool key(
+      const char* const* inputNames,
+      const Ort::Value* inputs,
+      size_t inputCount,
+      const char* const* outputNames,
+      size_t outputCount,
+      ResultKey& key);
+    // Copy of the cached outputs, null on a miss.
+    std::shared_ptr<std::vector<Ort::Value>> find(const ResultKey& key);
+    // Non-tensor outputs and results over maxBytes are not cached, nor
+    // results whose hash is already taken by another key.
+    void insert(const ResultKey& key, const std::vector<Ort::Value>& outputs);
+    void clear();
+    ResultCacheStats getStats() const;
+  };
+};
+
+#endif // __CRT_RESULT_CACHE_H__
@@ -0,0 +1,120 @@
+#ifndef __CRT_RING_BUFFER_H__
+#define __CRT_RING_BUFFER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace cinrt::model
+{
+  // Bounded lock-free MPMC queue. Every cell carries a sequence number
+  // telling producers and consumers whose turn it is, so each side only
+  // contends on its own index. Capacity is rounded up to a power of two.
+  template <typename T>
+  class RingBuffer
+  {
+  protected:
+    struct alignas(64) Cell
+    {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+
+  public:
+    explicit RingBuffer(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity)
+        size <<= 1;
+      _cells.reset(new Cell[size]);
+      _mask = size - 1;
+      for (size_t i = 0; i < size; ++i)
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Returns false when full.
+    bool tryPush(T value) {
+      size_t position = _tail.load(std::memory_order_relaxed);
+      while (true) {
+        Cell& cell = _cells[position & _mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (diff == 0) {
+          if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            cell.value = std::move(value);
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          position = _tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // Returns false when empty.
+    bool tryPop(T& value) {
+      size_t position = _head.load(std::memory_order_relaxed);
+      while (true) {
+        Cell& cell = _cells[position & _mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+        if (diff == 0) {
+          if (_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            value = std::move(cell.value);
+            cell.sequence.store(position + _mask + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          position = _head.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // Approximate while other threads are pushing or popping.
+    size_t size() const {
+      size_t tail = _tail.load(std::memory_order_relaxed);
+      size_t head = _head.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+    }
+    size_t capacity() const { return _mask + 1; }
+  };
+
+  // Waits on a lock-free structure: spins first, then yields, then sleeps
+  // so idle stages do not burn a core.
+  class Backoff
+  {
+  protected:
+    int _count = 0;
+
+  public:
+    void pause() {
+      if (_count < 64) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        __builtin_ia32_pause();
+#endif
+      } else if (_count < 128) {
+        std::this_thread::yield();
+      } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        return;
+      }
+      ++_count;
+    }
+    void reset() { _count = 0; }
+  };
+};
+
+#endif // __CRT_RING_BUFFER_H__
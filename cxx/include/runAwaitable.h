@@ -0,0 +1,83 @@
+#ifndef __CRT_RUN_AWAITABLE_H__
+#define __CRT_RUN_AWAITABLE_H__
+
+// C++20 only, the library itself builds as C++17.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <atomic>
+#include <coroutine>
+#include <memory>
+#include <string>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "core.h"
+
+namespace cinrt::model
+{
+  // co_await of Model::runCallback. The coroutine resumes on the ORT thread
+  // that completed the run, or does not suspend when the run completes
+  // inline. Yields null when the run failed.
+  class RunAwaitable
+  {
+  protected:
+    Model& _model;
+    std::vector<std::string> _inputNames;
+    std::vector<Ort::Value> _inputs;
+    std::vector<std::string> _outputNames;
+    Ort::RunOptions _runOptions;
+    std::shared_ptr<std::vector<Ort::Value>> _outputs;
+    std::coroutine_handle<> _handle;
+    // Set by whichever of await_suspend and the callback comes first.
+    std::atomic<bool> _ready{false};
+
+  public:
+    RunAwaitable(
+      Model& model,
+      std::vector<std::string> inputNames,
+      std::vector<Ort::Value> inputs,
+      std::vector<std::string> outputNames,
+      Ort::RunOptions runOptions)
+      : _model(model), _inputNames(std::move(inputNames)), _inputs(std::move(inputs)),
+        _outputNames(std::move(outputNames)), _runOptions(std::move(runOptions)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle){
+      _handle = handle;
+      _model.runCallback(std::move(_inputNames), std::move(_inputs),
+        [this](std::shared_ptr<std::vector<Ort::Value>> outputs){
+          _outputs = std::move(outputs);
+          if (_ready.exchange(true, std::memory_order_acq_rel))
+            _handle.resume();
+        },
+        std::move(_outputNames), std::move(_runOptions));
+      return !_ready.exchange(true, std::memory_order_acq_rel);
+    }
+
+    std::shared_ptr<std::vector<Ort::Value>> await_resume(){ return std::move(_outputs); }
+  };
+
+  // co_await runAwaitable(model, std::move(inputs)), see Model::runCallback.
+  inline RunAwaitable runAwaitable(
+    Model& model,
+    Ort::Value inputs,
+    std::shared_ptr<const char*> outputHead = nullptr,
+    Ort::RunOptions runOptions = Ort::RunOptions()){
+    std::vector<Ort::Value> values;
+    values.push_back(std::move(inputs));
+    std::vector<std::string> outputNames;
+    outputNames.push_back(outputHead != nullptr ? *outputHead : model.getOutputs().at(0).name);
+    return RunAwaitable(model, {model.getInputs().at(0).name}, std::move(values), std::move(outputNames), std::move(runOptions));
+  }
+
+  inline RunAwaitable runAwaitable(
+    Model& model,
+    std::vector<std::string> inputNames,
+    std::vector<Ort::Value> inputs,
+    std::vector<std::string> outputNames = {},
+    Ort::RunOptions runOptions = Ort::RunOptions()){
+    return RunAwaitable(model, std::move(inputNames), std::move(inputs), std::move(outputNames), std::move(runOptions));
+  }
+};
+#endif
+
+#endif // __CRT_RUN_AWAITABLE_H__
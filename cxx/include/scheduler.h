@@ -0,0 +1,161 @@
+#ifndef __CRT_SCHEDULER_H__
+#define __CRT_SCHEDULER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "bufferPool.h"
+
+namespace cinrt::model
+{
+  class Model;
+
+  enum class Priority
+  {
+    Interactive,  // served first
+    Batch         // served from the workers interactive traffic leaves
+  };
+
+  struct RequestOptions
+  {
+    Priority priority = Priority::Interactive;
+    // Requests still queued at their deadline are dropped, runs past it are
+    // terminated. None by default.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    // Deadline budget from now.
+    static RequestOptions within(std::chrono::microseconds budget, Priority priority = Priority::Interactive) {
+      return {priority, std::chrono::steady_clock::now() + budget};
+    }
+  };
+
+  struct SchedulerOptions
+  {
+    // Runs of one model at once. A pool made for the model alone, or by a
+    // modelManager for all of its models, has as many threads.
+    size_t workers = 2;
+    // Batch runs at once, kept below workers so interactive requests never
+    // wait behind a batch run.
+    size_t batchSlots = 1;
+    // Queued requests over both priorities, submit throws beyond it.
+    size_t capacity = 1024;
+  };
+
+  // Worker threads and deadline watchdog shared by Schedulers, so threads
+  // do not grow with the models served. Interactive tasks are taken first,
+  // batch tasks hold at most workers - 1 threads. Timers fire in deadline
+  // order from a single watchdog thread.
+  class SchedulerPool
+  {
+  protected:
+    struct Timer
+    {
+      std::chrono::steady_clock::time_point at;
+      std::function<void()> fire;
+      bool operator>(const Timer& other) const { return at > other.at; }
+    };
+
+    // Indexed by Priority.
+    std::deque<std::function<void()>> _tasks[2];
+    size_t _batchSlots;
+    size_t _runningBatch = 0;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> _timers;
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::condition_variable _watch;
+    bool _stop = false;
+    std::vector<std::thread> _workers;
+    std::thread _watchdog;
+
+    void work();
+    void watch();
+
+  public:
+    explicit SchedulerPool(size_t workers = 2);
+    // Tasks not started yet are dropped.
+    ~SchedulerPool();
+    void post(Priority priority, std::function<void()> task);
+    // Calls fire on the watchdog thread once time has come.
+    void at(std::chrono::steady_clock::time_point time, std::function<void()> fire);
+    size_t workers() const { return _workers.size(); }
+  };
+
+  // Earliest-deadline-first queues of one model, one per priority, served
+  // by a SchedulerPool. The pool runs the interactive request with the
+  // nearest deadline, then batch requests while fewer than batchSlots
+  // batch runs are going. Its watchdog fails requests whose deadline passes
+  // in the queue and stops runs past their deadline with
+  // RunOptions::SetTerminate.
+  class Scheduler
+  {
+  protected:
+    struct Request
+    {
+      RequestOptions options;
+      BufferPool::Tensor input;
+      std::shared_ptr<const char*> outputHead;
+      Ort::RunOptions runOptions;
+      std::promise<std::shared_ptr<std::vector<Ort::Value>>> promise;
+      std::chrono::steady_clock::time_point submitted;
+      bool terminated = false;
+    };
+    using Queue = std::multimap<std::chrono::steady_clock::time_point, std::unique_ptr<Request>>;
+
+    // Shared with the pool tasks and timers, which may outlive the Scheduler.
+    // Every queued request has a task posted or deferred in its priority.
+    struct State
+    {
+      Model* model = nullptr;
+      SchedulerOptions options;
+      // Indexed by Priority, ordered by deadline.
+      Queue queues[2];
+      std::set<Request*> running;
+      // Pool threads working on this model, see ~Scheduler.
+      size_t active = 0;
+      size_t runningBatch = 0;
+      // Tasks put off while the model had no free slot, posted again when
+      // a run ends.
+      size_t deferred[2] = {0, 0};
+      std::mutex mutex;
+      std::condition_variable idle;
+      bool stop = false;
+    };
+
+    std::shared_ptr<SchedulerPool> _pool;
+    std::shared_ptr<State> _state;
+    Ort::AllocatorWithDefaultOptions _allocator;
+
+    static void post(const std::shared_ptr<State>& state, SchedulerPool& pool, Priority priority);
+    // Runs the next request of priority, or defers when the model is busy.
+    static void runNext(const std::shared_ptr<State>& state, SchedulerPool& pool, Priority priority);
+    static void watch(State& state);
+    static void expire(State& state, std::unique_ptr<Request> request, const char* reason);
+
+  public:
+    // Without a pool, one is made for this scheduler with options.workers
+    // threads.
+    Scheduler(Model* model, const SchedulerOptions& options = SchedulerOptions(), std::shared_ptr<SchedulerPool> pool = nullptr);
+    // Waits for the runs going, requests still queued fail.
+    ~Scheduler();
+    // Input is copied, so the caller may release it right away. Expired
+    // requests fail with std::runtime_error.
+    std::future<std::shared_ptr<std::vector<Ort::Value>>> submit(
+      const Ort::Value& inputs,
+      const RequestOptions& request,
+      std::shared_ptr<const char*> outputHead = nullptr,
+      Ort::RunOptions runOptions = Ort::RunOptions());
+    size_t pending();
+  };
+};
+
+#endif // __CRT_SCHEDULER_H__
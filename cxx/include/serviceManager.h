@@ -2,27 +2,57 @@
 #define __SERVICE_H__
 #include "core.h"
 #include <thread>
+#include <condition_variable>
 
 using namespace cinrt::model;
 
+// Order in which unpinned models are evicted.
+enum class EvictionPolicy
+{
+    LRU,        // least recently used first
+    CostAware   // cheapest to lose first: reload time x use frequency
+};
+
 class serviceManager : public modelManager
 {
 private:
+    // Last use and use counts live on the models, lookups never take clockMutex.
+    struct SessionUsage
+    {
+        std::chrono::steady_clock::time_point loaded;
+    };
+
     // std::map<char*, float> sessionClock;
-    std::map<std::string, std::chrono::steady_clock::time_point> sessionClock;
+    std::map<std::string, SessionUsage> sessionClock;
     std::thread gc;
     std::mutex clockMutex;
+    std::condition_variable gcWake;
     bool stopGCFlag = false;
+    size_t memoryBudget = 0;
+    std::chrono::milliseconds idleTimeout{60000};
+    EvictionPolicy evictionPolicy = EvictionPolicy::LRU;
     
     void garbageCollector();
+    // Models to evict, most evictable first.
+    std::vector<std::string> evictionOrder(std::chrono::steady_clock::time_point now);
+
+protected:
+    void onModelLoaded(const std::string& model) override;
+
 public:
     // serviceManager(std::shared_ptr<Ort::Env> env, std::shared_ptr<Ort::Allocator> allocator);
     serviceManager(std::shared_ptr<Ort::Env> env);
+    serviceManager(const ThreadPoolOptions& threadPool);
     ~serviceManager();
     void updateSessionClock(std::string model);
     float getSessionClock(std::string model);
+    // Evict unpinned models while the summed footprint exceeds bytes, 0 disables.
+    void setMemoryBudget(size_t bytes);
+    // Evict unpinned models idle for longer than timeout, 0 disables.
+    void setIdleTimeout(std::chrono::milliseconds timeout);
+    void setEvictionPolicy(EvictionPolicy policy);
     void startGC();
     void stopGC();
 };
 
-#endif // __SERVICE_H__
\ No newline at end of file
+#endif // __SERVICE_H__
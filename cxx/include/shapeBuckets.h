@@ -0,0 +1,76 @@
+#ifndef __CRT_SHAPE_BUCKETS_H__
+#define __CRT_SHAPE_BUCKETS_H__
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include "binding.h"
+#include "postprocess.h"
+#include "preprocess.h"
+
+namespace cinrt::model
+{
+  class Model;
+
+  struct BucketOptions
+  {
+    // {width, height} of the image input, at least one for dynamic inputs.
+    // Fixed input dims default to, and must match, the model size.
+    std::vector<std::pair<int, int>> sizes;
+    uint8_t padValue = 114;
+    // Scale images up to fill their bucket. Otherwise images only get
+    // padded, and scaled down when larger than every bucket.
+    bool upscale = false;
+    PreprocessOptions preprocess;
+  };
+
+  struct BucketedOutputs
+  {
+    std::vector<Ort::Value> outputs;
+    // Per image, maps output coordinates back to it, see rescale.
+    std::vector<Rescale> scales;
+    // Bucket the batch ran at.
+    int width = 0;
+    int height = 0;
+  };
+
+  // Runs images of any size at a fixed set of input shapes, so ORT reuses
+  // its memory patterns and arena chunks instead of planning every new
+  // resolution. Each batch goes to the smallest bucket holding all of its
+  // images, letterboxed. Buckets keep their input buffer and IoBinding,
+  // a bucket serves one batch at a time.
+  class ShapeBuckets
+  {
+  protected:
+    struct Bucket
+    {
+      int width = 0;
+      int height = 0;
+      std::mutex mutex;
+      int64_t batch = 0;
+      Ort::Value input{nullptr};
+      std::unique_ptr<Binding> binding;
+    };
+
+    Model* _model;
+    BucketOptions _options;
+    std::string _inputName;
+    // Fixed batch dim of the input, 0 when dynamic.
+    int64_t _batch = 0;
+    Ort::AllocatorWithDefaultOptions _allocator;
+    // Sorted by area.
+    std::vector<std::unique_ptr<Bucket>> _buckets;
+
+    Bucket& pick(int width, int height);
+
+  public:
+    ShapeBuckets(Model* model, const BucketOptions& options);
+    // Images are 3-channel, see ImageView.
+    BucketedOutputs run(const std::vector<ImageView>& images, const Ort::RunOptions& runOptions = Ort::RunOptions());
+  };
+};
+
+#endif // __CRT_SHAPE_BUCKETS_H__
@@ -0,0 +1,148 @@
+#ifndef __CRT_SHARED_MEMORY_H__
+#define __CRT_SHARED_MEMORY_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cinrt::model
+{
+  // Positions of a SharedRing, they only grow and wrap modulo the ring size.
+  struct SharedRingHeader
+  {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+  };
+
+  // Byte ring in shared memory written by one process and read by another.
+  // Blocks are contiguous and 64-byte aligned, and are released in the
+  // order they were allocated, up to a head position the writer sends along.
+  class SharedRing
+  {
+  protected:
+    SharedRingHeader* _header = nullptr;
+    uint8_t* _data = nullptr;
+    uint64_t _size = 0;
+
+  public:
+    SharedRing() = default;
+    SharedRing(SharedRingHeader* header, uint8_t* data, uint64_t size) : _header(header), _data(data), _size(size) {}
+
+    // Writer side, false when the unreleased blocks leave no room.
+    bool allocate(uint64_t bytes, uint64_t& offset);
+    uint64_t head() const { return _header->head.load(std::memory_order_relaxed); }
+    // Writer side, drops the blocks allocated since head position start.
+    void rewind(uint64_t start) { _header->head.store(start, std::memory_order_relaxed); }
+    // Reader side, frees every block allocated before head position end.
+    void release(uint64_t end) { _header->tail.store(end, std::memory_order_release); }
+    // Null when the block is not inside the ring.
+    uint8_t* at(uint64_t offset, uint64_t bytes) const {
+      return offset <= _size && bytes <= _size - offset ? _data + offset : nullptr;
+    }
+    uint64_t size() const { return _size; }
+  };
+
+  // Anonymous shared mapping holding a ring per direction. Processes share
+  // it by passing its descriptor over a Unix socket, see sendDescriptor.
+  // Its size is sealed where memfd is available, so the peer that maps it
+  // cannot be faulted by a later truncation.
+  class SharedRegion
+  {
+  protected:
+    int _fd = -1;
+    void* _base = nullptr;
+    size_t _bytes = 0;
+    uint64_t _ringBytes = 0;
+
+    void map();
+
+  public:
+    // Creates a region with two rings of ringBytes, rounded up to 64 bytes.
+    explicit SharedRegion(size_t ringBytes);
+    // Maps a region of two rings of ringBytes received from its creator,
+    // takes the descriptor. Throws unless its size is sealed and holds them.
+    static SharedRegion attach(int fd, uint64_t ringBytes);
+    SharedRegion(SharedRegion&& other) noexcept;
+    SharedRegion(const SharedRegion&) = delete;
+    SharedRegion& operator=(const SharedRegion&) = delete;
+    ~SharedRegion();
+
+    int fd() const { return _fd; }
+    uint64_t ringBytes() const { return _ringBytes; }
+    // Written by the client, read by the server.
+    SharedRing requests() const;
+    // Written by the server, read by the client.
+    SharedRing responses() const;
+
+  private:
+    SharedRegion() = default;
+  };
+
+  // Reply status of the local server protocol.
+  enum class LocalStatus : uint8_t
+  {
+    Ok,
+    // The run failed, Model::run returned null.
+    Failed,
+    // Unknown model, bad request or no room for the outputs, with a message.
+    Error
+  };
+
+  // Control message of the local server protocol: fixed-size fields and
+  // strings, framed by a 32-bit length. Tensor bytes travel in a SharedRing.
+  class WireMessage
+  {
+  protected:
+    std::vector<char> _bytes;
+    size_t _read = 0;
+
+  public:
+    template <typename T>
+    void put(const T& value){
+      const char* bytes = reinterpret_cast<const char*>(&value);
+      _bytes.insert(_bytes.end(), bytes, bytes + sizeof(T));
+    }
+    void putString(const std::string& value){
+      put(static_cast<uint32_t>(value.size()));
+      _bytes.insert(_bytes.end(), value.begin(), value.end());
+    }
+    template <typename T>
+    T get(){
+      if (_bytes.size() - _read < sizeof(T))
+        throw std::runtime_error("Truncated message");
+      T value;
+      std::memcpy(&value, _bytes.data() + _read, sizeof(T));
+      _read += sizeof(T);
+      return value;
+    }
+    std::string getString(){
+      uint32_t size = get<uint32_t>();
+      if (_bytes.size() - _read < size)
+        throw std::runtime_error("Truncated message");
+      std::string value(_bytes.data() + _read, size);
+      _read += size;
+      return value;
+    }
+    void append(const WireMessage& other){
+      _bytes.insert(_bytes.end(), other._bytes.begin(), other._bytes.end());
+    }
+    void clear(){
+      _bytes.clear();
+      _read = 0;
+    }
+    // Blocking, false when the peer is gone.
+    bool send(int socket) const;
+    bool receive(int socket);
+  };
+
+  // Passes a descriptor to the peer of a Unix socket.
+  bool sendDescriptor(int socket, int fd);
+  // -1 when the peer sent none or is gone.
+  int receiveDescriptor(int socket);
+};
+
+#endif // __CRT_SHARED_MEMORY_H__
@@ -0,0 +1,28 @@
+#ifndef __CRT_TENSOR_H__
+#define __CRT_TENSOR_H__
+
+#include <cstdint>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+
+namespace cinrt::model
+{
+  // Size in bytes of one element, 0 for non fixed-size types (strings).
+  size_t elementSize(ONNXTensorElementDataType type);
+  // Total size in bytes of a dense tensor.
+  size_t tensorBytes(const Ort::Value& value);
+  // IEEE half precision bits of value, rounded to nearest even.
+  uint16_t toHalf(float value);
+  // Deep copy of a tensor into memory owned by allocator.
+  Ort::Value cloneTensor(const Ort::Value& value, OrtAllocator* allocator);
+  // Concatenate tensors with identical type and trailing dims along dim 0.
+  Ort::Value concatTensors(const std::vector<const Ort::Value*>& values, OrtAllocator* allocator);
+  // Split a tensor along dim 0 into parts of the given row counts.
+  std::vector<Ort::Value> splitTensor(const Ort::Value& value, const std::vector<int64_t>& rows, OrtAllocator* allocator);
+  // Split {N, columns} rows whose column 0 is the batch index of the row,
+  // e.g. end-to-end detection exports, into parts of the given batch
+  // counts. Indexes are rebased on each part, rows out of range dropped.
+  std::vector<Ort::Value> splitByBatchIndex(const Ort::Value& value, const std::vector<int64_t>& batches, OrtAllocator* allocator);
+};
+
+#endif // __CRT_TENSOR_H__
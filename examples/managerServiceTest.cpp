@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "core.h"
 #include "serviceManager.h"
 #include <onnxruntime_cxx_api.h>
@@ -7,12 +8,13 @@
 
 using namespace cinrt::model;
 
-Ort::Value createMockInput(Ort::MemoryInfo& memoryInfo, int64_t batchSize = 1, int64_t channels = 9, int64_t height = 256, int64_t width = 256) {
+BufferPool::Tensor createMockInput(BufferPool& pool, int64_t batchSize = 1, int64_t channels = 9, int64_t height = 256, int64_t width = 256) {
     // const std::array<int64_t, 4> inputShape = {1, 9, 256, 256};
-    // std::vector<float> inputValues(1 * 9 * 256 * 256, 1.0f);
-    const std::array<int64_t, 4> inputShape = {batchSize, channels, height, width};
-    std::vector<float> inputValues(batchSize * channels * height * width, 1.0f);
-    return Ort::Value::CreateTensor<float>(memoryInfo, inputValues.data(), inputValues.size(), inputShape.data(), inputShape.size());
+    // Pooled, so the buffer lives as long as the tensor.
+    BufferPool::Tensor input = pool.tensor<float>({batchSize, channels, height, width});
+    float* inputValues = input.value.GetTensorMutableData<float>();
+    std::fill(inputValues, inputValues + batchSize * channels * height * width, 1.0f);
+    return input;
 }
 
 int main() {
@@ -27,13 +29,12 @@ int main() {
     Model* model = manager.createModel(modelPath1);
     Model* model2 = manager.createModel(modelPath2);
     
-    Ort::MemoryInfo memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value inputTensor1 = createMockInput(memoryInfo , 1, 9, 256, 256);
-    Ort::Value inputTensor2 = createMockInput(memoryInfo, 1, 3, 640, 640);
+    BufferPool::Tensor inputTensor1 = createMockInput(*manager.getBufferPool(), 1, 9, 256, 256);
+    BufferPool::Tensor inputTensor2 = createMockInput(*manager.getBufferPool(), 1, 3, 640, 640);
 
     
     try {
-        std::shared_ptr<std::vector<Ort::Value>> outputTensor1 = model->run(inputTensor1);
+        std::shared_ptr<std::vector<Ort::Value>> outputTensor1 = model->run(inputTensor1.value);
         float* outputData1 = outputTensor1->at(0).GetTensorMutableData<float>();
         std::cout << "Model output: " << outputData1[0] << std::endl;
     } catch (const std::exception& e) {
@@ -0,0 +1,590 @@
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+#include <onnxruntime_cxx_api.h>
+#include <benchmark/benchmark.h>
+
+#include "core.h"
+#include "resources.h"
+#include "serviceManager.h"
+#include "onnxModel.h"
+
+using namespace cinrt::model;
+using Clock = std::chrono::steady_clock;
+
+// Generated at startup, so the suite needs no model files.
+static std::string smallModel;
+static std::string largeModel;
+static std::string convModel;
+static std::string nonZeroModel;
+static std::string cacheDir;
+static constexpr int SMALL_WIDTH = 64;
+static constexpr int LARGE_WIDTH = 512;
+
+static std::shared_ptr<Ort::Env> sharedEnv() {
+    static std::shared_ptr<Ort::Env> env = std::make_shared<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "benchmark");
+    return env;
+}
+
+static Ort::Value createInput(int64_t batch, int64_t width) {
+    Ort::AllocatorWithDefaultOptions allocator;
+    const std::array<int64_t, 2> shape = {batch, width};
+    Ort::Value value = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+    float* data = value.GetTensorMutableData<float>();
+    std::fill(data, data + batch * width, 0.5f);
+    return value;
+}
+
+static double micros(Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+// p50 / p99 of the recorded latencies and the resident memory at the end.
+static void report(benchmark::State& state, std::vector<double>& latencies, const std::string& prefix = "") {
+    state.counters["rss_mb"] = residentBytes() / (1024.0 * 1024.0);
+    if (latencies.empty())
+        return;
+    std::sort(latencies.begin(), latencies.end());
+    state.counters[prefix + "p50_us"] = latencies[latencies.size() / 2];
+    state.counters[prefix + "p99_us"] = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+}
+
+// Model::run over parallel x graphOpLevel x interThreads x intraThreads.
+static void BM_Run(benchmark::State& state) {
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(largeModel, state.range(0), state.range(1), state.range(2), state.range(3));
+    Ort::Value input = createInput(1, LARGE_WIDTH);
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        std::shared_ptr<std::vector<Ort::Value>> outputs = model->run(input);
+        latencies.push_back(micros(Clock::now() - start));
+        benchmark::DoNotOptimize(outputs);
+    }
+    report(state, latencies);
+}
+
+// Model::runAsync with depth requests outstanding.
+static void BM_RunAsync(benchmark::State& state) {
+    const int depth = state.range(0);
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(largeModel, true, 1, 1, state.range(1));
+    Ort::Value input = createInput(1, LARGE_WIDTH);
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        std::vector<std::future<std::shared_ptr<std::vector<Ort::Value>>>> futures;
+        for (int i = 0; i < depth; ++i)
+            futures.push_back(model->runAsync(input));
+        for (auto& future : futures)
+            future.get();
+        latencies.push_back(micros(Clock::now() - start) / depth);
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+    report(state, latencies);
+}
+
+// Model::runCallback with depth requests outstanding, no thread waits on
+// them but the one waiting for the last completion.
+static void BM_RunCallback(benchmark::State& state) {
+    const int depth = state.range(0);
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(largeModel, true, 1, 1, state.range(1));
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        // Inputs are moved into the runs.
+        std::vector<Ort::Value> inputs;
+        for (int i = 0; i < depth; ++i)
+            inputs.push_back(createInput(1, LARGE_WIDTH));
+        std::atomic<int> remaining{depth};
+        std::promise<void> finished;
+        auto start = Clock::now();
+        for (Ort::Value& value : inputs)
+            model->runCallback(std::move(value), [&](std::shared_ptr<std::vector<Ort::Value>> outputs) {
+                benchmark::DoNotOptimize(outputs);
+                if (remaining.fetch_sub(1) == 1)
+                    finished.set_value();
+            });
+        finished.get_future().wait();
+        latencies.push_back(micros(Clock::now() - start) / depth);
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+    report(state, latencies);
+}
+
+// Client threads sharing a model, each run routed through acquireModel.
+static void BM_Throughput(benchmark::State& state) {
+    const int clients = state.range(0);
+    const int replicas = state.range(1);
+    const int runsPerClient = 32;
+    modelManager manager(sharedEnv());
+    manager.createModel(largeModel, false, 1, 1, 1, replicas);
+    std::vector<std::vector<double>> perClient(clients);
+    for (auto _ : state) {
+        std::vector<std::thread> threads;
+        for (int c = 0; c < clients; ++c) {
+            threads.emplace_back([&, c] {
+                Ort::Value input = createInput(1, LARGE_WIDTH);
+                for (int i = 0; i < runsPerClient; ++i) {
+                    auto start = Clock::now();
+                    std::shared_ptr<Model> model = manager.acquireModel(largeModel);
+                    model->run(input);
+                    perClient[c].push_back(micros(Clock::now() - start));
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+    std::vector<double> latencies;
+    for (std::vector<double>& client : perClient)
+        latencies.insert(latencies.end(), client.begin(), client.end());
+    state.SetItemsProcessed(state.iterations() * clients * runsPerClient);
+    report(state, latencies);
+}
+
+// Interactive runs while a batch client keeps a backlog of 16 requests on
+// the same model, queued FIFO on an executor or scheduled by priority.
+static void BM_Scheduling(benchmark::State& state) {
+    const bool scheduled = state.range(0);
+    const int backlog = 16;
+    modelManager manager(sharedEnv());
+    SchedulerOptions options;
+    options.workers = 2;
+    manager.setScheduling(std::make_shared<SchedulerOptions>(options));
+    Model* model = manager.createModel(largeModel, false, 3, 1, 1);
+    model->setExecutor(std::make_shared<Executor>(options.workers));
+    Ort::Value input = createInput(64, LARGE_WIDTH);
+    Ort::Value interactive = createInput(1, LARGE_WIDTH);
+    auto submit = [&](const Ort::Value& value, Priority priority) {
+        if (scheduled)
+            return model->runScheduled(value, {priority});
+        return model->runAsync(value);
+    };
+    std::atomic<bool> stop{false};
+    std::thread batch([&] {
+        std::deque<std::future<std::shared_ptr<std::vector<Ort::Value>>>> pending;
+        while (!stop) {
+            while (pending.size() < backlog)
+                pending.push_back(submit(input, Priority::Batch));
+            pending.front().get();
+            pending.pop_front();
+        }
+        for (auto& result : pending)
+            result.get();
+    });
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        benchmark::DoNotOptimize(submit(interactive, Priority::Interactive).get());
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    stop = true;
+    batch.join();
+    report(state, latencies);
+}
+
+// Model::run with outputs in recycled buffers or allocated by ORT, inputs
+// come from the pool in both cases.
+static void BM_BufferPool(benchmark::State& state) {
+    const bool pooled = state.range(0);
+    const int64_t batch = state.range(1);
+    modelManager manager(sharedEnv());
+    std::shared_ptr<BufferPool> pool = manager.getBufferPool();
+    if (!pooled)
+        manager.setBufferPool(nullptr);
+    Model* model = manager.createModel(largeModel, false, 3);
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        BufferPool::Tensor input = pool->tensor<float>({batch, LARGE_WIDTH});
+        std::fill_n(input.value.GetTensorMutableData<float>(), batch * LARGE_WIDTH, 0.5f);
+        std::shared_ptr<std::vector<Ort::Value>> outputs = model->run(input.value);
+        benchmark::DoNotOptimize(outputs);
+        outputs.reset();
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    BufferPoolStats stats = pool->getStats();
+    state.counters["pool_hits"] = stats.hits;
+    state.counters["pool_misses"] = stats.misses;
+    report(state, latencies);
+}
+
+// A stream of inputs where duplicates percent repeat one of 8 recent ones,
+// run with or without a result cache.
+static void BM_ResultCache(benchmark::State& state) {
+    const bool cached = state.range(0);
+    const int duplicates = state.range(1);
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(largeModel, false, 3);
+    if (cached)
+        manager.setResultCache(largeModel, size_t(64) << 20);
+    std::vector<Ort::Value> recent;
+    for (int i = 0; i < 8; ++i) {
+        recent.push_back(createInput(1, LARGE_WIDTH));
+        recent.back().GetTensorMutableData<float>()[0] = -1.0f - i;
+    }
+    Ort::Value fresh = createInput(1, LARGE_WIDTH);
+    std::mt19937 rng(0);
+    float counter = 0;
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        const Ort::Value* input = &recent[rng() % recent.size()];
+        if (static_cast<int>(rng() % 100) >= duplicates) {
+            fresh.GetTensorMutableData<float>()[0] = ++counter;
+            input = &fresh;
+        }
+        auto start = Clock::now();
+        benchmark::DoNotOptimize(model->run(*input));
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    if (std::shared_ptr<ResultCache> cache = model->getResultCache()) {
+        ResultCacheStats stats = cache->getStats();
+        state.counters["cache_hits"] = stats.hits;
+        state.counters["cache_misses"] = stats.misses;
+    }
+    report(state, latencies);
+}
+
+// Model::run in process or through a LocalClient. The client shares the
+// process with the server here, the round trip still crosses the socket and
+// the shared rings.
+static void BM_LocalServer(benchmark::State& state) {
+    const bool local = state.range(0);
+    const int batch = state.range(1);
+    serviceManager service(sharedEnv());
+    Model* model = service.createModel(largeModel, false, 3);
+    const std::string socketPath = (std::filesystem::temp_directory_path() / "cinnamon-bench.sock").string();
+    std::unique_ptr<LocalClient> client;
+    if (local) {
+        service.serveLocal(socketPath);
+        client = std::make_unique<LocalClient>(socketPath);
+    }
+    Ort::Value input = createInput(batch, LARGE_WIDTH);
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        if (local)
+            benchmark::DoNotOptimize(client->run(largeModel, input));
+        else
+            benchmark::DoNotOptimize(model->run(input));
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    report(state, latencies);
+}
+
+// A stream of images of mixed resolutions, run at their own size or
+// letterboxed into three shape buckets.
+static void BM_ShapeBuckets(benchmark::State& state) {
+    const bool bucketed = state.range(0);
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(convModel, false, 3);
+    if (bucketed) {
+        BucketOptions options;
+        options.sizes = {{320, 320}, {480, 480}, {640, 640}};
+        model->enableShapeBuckets(options);
+    }
+    std::mt19937 rng(0);
+    std::vector<std::pair<int, int>> sizes;
+    for (int i = 0; i < 64; ++i)
+        sizes.emplace_back(160 + rng() % 481, 160 + rng() % 481);
+    std::vector<uint8_t> pixels(640 * 640 * 3, 128);
+    std::vector<double> latencies;
+    size_t next = 0;
+    for (auto _ : state) {
+        const auto& [width, height] = sizes[next++ % sizes.size()];
+        ImageView image{pixels.data(), width, height, 0};
+        auto start = Clock::now();
+        if (bucketed) {
+            BucketedOutputs outputs = model->runBucketed({image});
+            benchmark::DoNotOptimize(outputs);
+        } else {
+            Ort::Value& input = model->preprocess({image}, {1, 3, height, width});
+            benchmark::DoNotOptimize(model->run(input));
+        }
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    report(state, latencies);
+}
+
+// A mostly static 640x480 video at 320x320 on the conv model, every frame
+// inferred or through a FrameStream. One frame in 20 changes the scene.
+static void BM_FrameStream(benchmark::State& state) {
+    const bool skipping = state.range(0);
+    const int width = 640;
+    const int height = 480;
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(convModel, false, 3);
+    FrameDeltaOptions options;
+    options.width = 320;
+    options.height = 320;
+    options.refreshEvery = skipping ? 30 : 1;
+    FrameStream stream(model, options);
+    std::mt19937 rng(0);
+    std::vector<std::vector<uint8_t>> scenes(2, std::vector<uint8_t>(width * height * 3));
+    for (std::vector<uint8_t>& scene : scenes)
+        for (uint8_t& value : scene)
+            value = rng() % 256;
+    std::vector<double> latencies;
+    size_t frame = 0;
+    for (auto _ : state) {
+        const std::vector<uint8_t>& scene = scenes[frame++ / 20 % scenes.size()];
+        ImageView image{scene.data(), width, height, 0};
+        auto start = Clock::now();
+        benchmark::DoNotOptimize(stream.next(image));
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    state.counters["inferred"] = benchmark::Counter(stream.inferences(), benchmark::Counter::kAvgIterations);
+    report(state, latencies);
+}
+
+// Crops of 640x480 detections fed at 112x112 to the conv model, through a
+// ModelGraph batching every crop into one run or one run per crop.
+static void BM_ModelGraph(benchmark::State& state) {
+    const bool graphed = state.range(0);
+    const size_t crops = state.range(1);
+    const int width = 640;
+    const int height = 480;
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(convModel, false, 3);
+    ModelGraph graph(manager);
+    graph.addCrops("crop", "image", "boxes", "crops");
+    graph.addModel("embed", convModel, {{model->getInputs()[0].name, "crops"}}, {{model->getOutputs()[0].name, "embeddings"}});
+    std::mt19937 rng(0);
+    std::vector<uint8_t> pixels(width * height * 3);
+    for (uint8_t& value : pixels)
+        value = rng() % 256;
+    ImageView image{pixels.data(), width, height, 0};
+    Detections boxes;
+    for (size_t i = 0; i < crops; ++i) {
+        const float x = rng() % (width - 160);
+        const float y = rng() % (height - 160);
+        boxes.x0.push_back(x);
+        boxes.y0.push_back(y);
+        boxes.x1.push_back(x + 40 + rng() % 120);
+        boxes.y1.push_back(y + 40 + rng() % 120);
+        boxes.score.push_back(1.f);
+        boxes.cls.push_back(0);
+    }
+    const std::array<int64_t, 4> shape = {1, 3, 112, 112};
+    Ort::AllocatorWithDefaultOptions allocator;
+    Ort::Value input = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        if (graphed) {
+            GraphValues values;
+            values.setImage("image", image);
+            values.setDetections("boxes", boxes);
+            graph.run(values);
+            benchmark::DoNotOptimize(values.tensor("embeddings"));
+        } else {
+            for (size_t i = 0; i < crops; ++i) {
+                const int x0 = boxes.x0[i];
+                const int y0 = boxes.y0[i];
+                ImageView crop{pixels.data() + (y0 * width + x0) * 3, static_cast<int>(boxes.x1[i]) - x0, static_cast<int>(boxes.y1[i]) - y0, width * 3};
+                imageToTensor(crop, input.GetTensorMutableData<float>(), 112, 112);
+                benchmark::DoNotOptimize(model->run(input));
+            }
+        }
+        latencies.push_back(micros(Clock::now() - start));
+    }
+    report(state, latencies);
+}
+
+// Model::run with CPU, XNNPACK or DNNL preferred, on the MLP and the conv
+// model. Providers missing from the ORT build skip, offloaded counts the
+// nodes not left to the CPU provider.
+static void BM_Providers(benchmark::State& state) {
+    static const std::array<const char*, 3> providers = {"CPU", "XNNPACK", "DNNL"};
+    const std::string provider = providers[state.range(0)];
+    const bool conv = state.range(1);
+    std::vector<std::string> available = availableProviders();
+    if (std::find(available.begin(), available.end(), providerName(provider)) == available.end()) {
+        state.SkipWithError((provider + " is not in this ORT build").c_str());
+        return;
+    }
+    modelManager manager(sharedEnv());
+    Model* model = manager.createModel(conv ? convModel : largeModel, false, 3, 0, 0, 1, {{provider, {}}});
+    std::vector<NodePlacement> placement = model->getNodePlacement();
+    Ort::Value input{nullptr};
+    if (conv) {
+        Ort::AllocatorWithDefaultOptions allocator;
+        const std::array<int64_t, 4> shape = {1, 3, 320, 320};
+        input = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+        std::fill_n(input.GetTensorMutableData<float>(), 3 * 320 * 320, 0.5f);
+    } else {
+        input = createInput(1, LARGE_WIDTH);
+    }
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        std::shared_ptr<std::vector<Ort::Value>> outputs = model->run(input);
+        latencies.push_back(micros(Clock::now() - start));
+        benchmark::DoNotOptimize(outputs);
+    }
+    state.counters["offloaded"] = std::count_if(placement.begin(), placement.end(), [](const NodePlacement& node) {
+        return node.provider != "CPUExecutionProvider";
+    });
+    report(state, latencies);
+}
+
+// createModel until the model can serve, with and without the optimized
+// model cache and memory mapping.
+static void BM_ColdStart(benchmark::State& state) {
+    const bool cached = state.range(0);
+    modelManager manager(sharedEnv());
+    manager.setMemoryMapping(state.range(1));
+    if (cached) {
+        manager.setCacheDir(cacheDir);
+        manager.createModel(largeModel, true, 3);
+        manager.delModel(largeModel);
+    }
+    std::vector<double> latencies;
+    double loadMs = 0;
+    for (auto _ : state) {
+        auto start = Clock::now();
+        manager.createModel(largeModel, true, 3);
+        latencies.push_back(micros(Clock::now() - start));
+        loadMs += manager.getLoadStats(largeModel).loadMs;
+        state.PauseTiming();
+        manager.delModel(largeModel);
+        state.ResumeTiming();
+    }
+    state.counters["load_ms"] = benchmark::Counter(loadMs, benchmark::Counter::kAvgIterations);
+    report(state, latencies);
+}
+
+// serviceManager evicting an idle model, then the reload on next use.
+// evict includes the 1 ms idle timeout and the GC wake-up.
+static void BM_EvictReload(benchmark::State& state) {
+    serviceManager service(sharedEnv());
+    std::vector<double> evictions;
+    std::vector<double> reloads;
+    for (auto _ : state) {
+        service.setIdleTimeout(std::chrono::milliseconds(0));
+        auto start = Clock::now();
+        Model* model = service.createModel(smallModel, true, 3);
+        model->run(createInput(1, SMALL_WIDTH));
+        auto loaded = Clock::now();
+        service.setIdleTimeout(std::chrono::milliseconds(1));
+        while (service.getReplicas(smallModel) > 0) {
+            if (Clock::now() - loaded > std::chrono::seconds(5)) {
+                state.SkipWithError("Model was not evicted");
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        auto evicted = Clock::now();
+        reloads.push_back(micros(loaded - start));
+        evictions.push_back(micros(evicted - loaded));
+        state.SetIterationTime(std::chrono::duration<double>(evicted - start).count());
+    }
+    report(state, evictions, "evict_");
+    report(state, reloads, "reload_");
+}
+
+// Pooled outputs must not break outputs sized by the data: every run of
+// the same input shape with another non-zero count has to succeed, while
+// the mlp, whose outputs follow its inputs, still runs into pooled buffers.
+static bool checkPooledOutputs() {
+    modelManager manager(sharedEnv());
+    std::shared_ptr<BufferPool> pool = manager.getBufferPool();
+    Model* model = manager.createModel(nonZeroModel, false, 3);
+    const int64_t width = 16;
+    const int counts[] = {3, 5, 3, 7, 1, 7, 16, 2};
+    for (int round = 0; round < 4; ++round) {
+        for (int count : counts) {
+            Ort::Value input = createInput(1, width);
+            float* data = input.GetTensorMutableData<float>();
+            std::fill(data, data + width, 0.f);
+            for (int i = 0; i < count; ++i)
+                data[i * width / count] = 1.f;
+            std::shared_ptr<std::vector<Ort::Value>> outputs = model->run(input);
+            if (outputs == nullptr) {
+                std::cerr << "NonZero, " << count << " non-zeros: run failed" << std::endl;
+                return false;
+            }
+            const Ort::Value& output = outputs->front();
+            if (output.GetTensorTypeAndShapeInfo().GetShape() != std::vector<int64_t>{2, count}) {
+                std::cerr << "NonZero, " << count << " non-zeros: wrong output shape" << std::endl;
+                return false;
+            }
+            const int64_t* indices = output.GetTensorData<int64_t>();
+            for (int i = 0; i < count; ++i) {
+                if (indices[i] != 0 || indices[count + i] != i * width / count) {
+                    std::cerr << "NonZero, " << count << " non-zeros: wrong index " << i << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    Model* mlp = manager.createModel(smallModel, false, 3);
+    Ort::Value input = createInput(4, SMALL_WIDTH);
+    std::shared_ptr<std::vector<Ort::Value>> expected = mlp->run(input);
+    uint64_t hits = pool->getStats().hits;
+    for (int i = 0; i < 4; ++i) {
+        std::shared_ptr<std::vector<Ort::Value>> outputs = mlp->run(input);
+        if (outputs == nullptr || !std::equal(
+                expected->front().GetTensorData<float>(), expected->front().GetTensorData<float>() + 4 * SMALL_WIDTH,
+                outputs->front().GetTensorData<float>())) {
+            std::cerr << "mlp: pooled run differs from the unpooled one" << std::endl;
+            return false;
+        }
+    }
+    if (pool->getStats().hits == hits) {
+        std::cerr << "mlp: outputs were not pooled" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+BENCHMARK(BM_Run)->ArgsProduct({
+    {0, 1},
+    {0, 1, 2, 3},
+    {1, 2},
+    {1, 2, 4}
+})->ArgNames({"parallel", "graphOpLevel", "inter", "intra"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RunAsync)->ArgsProduct({{1, 4, 16}, {1, 4}})->ArgNames({"depth", "intra"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_RunCallback)->ArgsProduct({{1, 16, 256}, {2, 4}})->ArgNames({"depth", "intra"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Throughput)->ArgsProduct({{1, 2, 4, 8}, {1, 2}})->ArgNames({"clients", "replicas"})->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Scheduling)->Arg(0)->Arg(1)->ArgName("scheduled")->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_BufferPool)->ArgsProduct({{0, 1}, {1, 64}})->ArgNames({"pooled", "batch"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ResultCache)->ArgsProduct({{0, 1}, {0, 50, 90}})->ArgNames({"cached", "duplicates"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LocalServer)->ArgsProduct({{0, 1}, {1, 64}})->ArgNames({"local", "batch"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ShapeBuckets)->Arg(0)->Arg(1)->ArgName("bucketed")->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FrameStream)->Arg(0)->Arg(1)->ArgName("skipping")->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ModelGraph)->ArgsProduct({{0, 1}, {1, 8, 32}})->ArgNames({"graph", "crops"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Providers)->ArgsProduct({{0, 1, 2}, {0, 1}})->ArgNames({"provider", "conv"})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ColdStart)->ArgsProduct({{0, 1}, {0, 1}})->ArgNames({"cached", "mapped"})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_EvictReload)->UseManualTime()->Iterations(20)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / "cinnamon-benchmark";
+    std::filesystem::create_directories(dir / "cache");
+    smallModel = (dir / "mlp-small.onnx").string();
+    largeModel = (dir / "mlp-large.onnx").string();
+    convModel = (dir / "conv.onnx").string();
+    nonZeroModel = (dir / "nonzero.onnx").string();
+    cacheDir = (dir / "cache").string();
+    onnxModel::save(smallModel, onnxModel::mlp(SMALL_WIDTH, 2));
+    onnxModel::save(largeModel, onnxModel::mlp(LARGE_WIDTH, 8));
+    onnxModel::save(convModel, onnxModel::conv(16, 3));
+    onnxModel::save(nonZeroModel, onnxModel::nonZero());
+
+    if (!checkPooledOutputs())
+        return 1;
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
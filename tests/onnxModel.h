@@ -0,0 +1,193 @@
+#ifndef __CRT_TESTS_ONNX_MODEL_H__
+#define __CRT_TESTS_ONNX_MODEL_H__
+
+// Writes small ONNX models without the onnx/protobuf libraries, so the
+// benchmarks run offline. Only the ModelProto fields they need are encoded.
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace onnxModel
+{
+    inline void varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    inline void field(std::string& out, int number, uint64_t value) {
+        varint(out, static_cast<uint64_t>(number) << 3);
+        varint(out, value);
+    }
+
+    inline void field(std::string& out, int number, const std::string& bytes) {
+        varint(out, (static_cast<uint64_t>(number) << 3) | 2);
+        varint(out, bytes.size());
+        out += bytes;
+    }
+
+    // TensorProto of floats: dims = 1, data_type = 2, name = 8, raw_data = 9.
+    inline std::string tensor(const std::string& name, const std::vector<int64_t>& dims, const std::vector<float>& values) {
+        std::string out;
+        for (int64_t dim : dims)
+            field(out, 1, static_cast<uint64_t>(dim));
+        field(out, 2, 1);
+        field(out, 8, name);
+        field(out, 9, std::string(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float)));
+        return out;
+    }
+
+    // ValueInfoProto of a tensor, float unless elemType says otherwise (int64 =
+    // 7). Negative dims become parameters named by params, "batch" when missing.
+    inline std::string valueInfo(const std::string& name, const std::vector<int64_t>& dims, const std::vector<std::string>& params = {}, int elemType = 1) {
+        std::string shape;
+        for (size_t i = 0; i < dims.size(); ++i) {
+            int64_t dim = dims[i];
+            std::string dimension;
+            if (dim < 0)
+                field(dimension, 2, i < params.size() ? params[i] : std::string("batch"));
+            else
+                field(dimension, 1, static_cast<uint64_t>(dim));
+            field(shape, 1, dimension);
+        }
+        std::string tensorType;
+        field(tensorType, 1, static_cast<uint64_t>(elemType));
+        field(tensorType, 2, shape);
+        std::string type;
+        field(type, 1, tensorType);
+        std::string out;
+        field(out, 1, name);
+        field(out, 2, type);
+        return out;
+    }
+
+    // AttributeProto of ints: name = 1, type = 20 (INTS = 7), ints = 8.
+    inline std::string ints(const std::string& name, const std::vector<int64_t>& values) {
+        std::string out;
+        field(out, 1, name);
+        field(out, 20, 7);
+        for (int64_t value : values)
+            field(out, 8, static_cast<uint64_t>(value));
+        return out;
+    }
+
+    inline std::string node(const std::string& op, const std::vector<std::string>& inputs, const std::string& output, const std::vector<std::string>& attributes = {}) {
+        std::string out;
+        for (const std::string& input : inputs)
+            field(out, 1, input);
+        field(out, 2, output);
+        field(out, 3, output);
+        field(out, 4, op);
+        for (const std::string& attribute : attributes)
+            field(out, 5, attribute);
+        return out;
+    }
+
+    // {batch, width} -> {batch, width} through layers of MatMul + Add + Relu.
+    inline std::string mlp(int width, int layers, uint32_t seed = 0) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        float scale = 1.f / width;
+        std::string graph;
+        std::string current = "input";
+        for (int layer = 0; layer < layers; ++layer) {
+            std::string index = std::to_string(layer);
+            std::vector<float> weight(static_cast<size_t>(width) * width), bias(width);
+            for (float& value : weight)
+                value = uniform(rng) * scale;
+            for (float& value : bias)
+                value = uniform(rng) * scale;
+            field(graph, 5, tensor("w" + index, {width, width}, weight));
+            field(graph, 5, tensor("b" + index, {width}, bias));
+            std::string output = layer + 1 == layers ? "output" : "relu" + index;
+            field(graph, 1, node("MatMul", {current, "w" + index}, "matmul" + index));
+            field(graph, 1, node("Add", {"matmul" + index, "b" + index}, "add" + index));
+            field(graph, 1, node("Relu", {"add" + index}, output));
+            current = output;
+        }
+        field(graph, 2, std::string("mlp"));
+        field(graph, 11, valueInfo("input", {-1, width}));
+        field(graph, 12, valueInfo("output", {-1, width}));
+
+        std::string opset;
+        field(opset, 2, 13);
+        std::string model;
+        field(model, 1, 7);
+        field(model, 2, std::string("cinnamon-benchmark"));
+        field(model, 7, graph);
+        field(model, 8, opset);
+        return model;
+    }
+
+    // {batch, 3, height, width} -> {batch, channels, height, width} through
+    // layers of 3x3 Conv + Relu, height and width are dynamic.
+    inline std::string conv(int channels, int layers, uint32_t seed = 0) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+        std::string graph;
+        std::string current = "input";
+        int inputs = 3;
+        for (int layer = 0; layer < layers; ++layer) {
+            std::string index = std::to_string(layer);
+            std::vector<float> weight(static_cast<size_t>(channels) * inputs * 9), bias(channels);
+            float scale = 1.f / (inputs * 9);
+            for (float& value : weight)
+                value = uniform(rng) * scale;
+            for (float& value : bias)
+                value = uniform(rng) * scale;
+            field(graph, 5, tensor("w" + index, {channels, inputs, 3, 3}, weight));
+            field(graph, 5, tensor("b" + index, {channels}, bias));
+            std::string output = layer + 1 == layers ? "output" : "relu" + index;
+            field(graph, 1, node("Conv", {current, "w" + index, "b" + index}, "conv" + index, {ints("pads", {1, 1, 1, 1})}));
+            field(graph, 1, node("Relu", {"conv" + index}, output));
+            current = output;
+            inputs = channels;
+        }
+        field(graph, 2, std::string("conv"));
+        field(graph, 11, valueInfo("input", {-1, 3, -1, -1}, {"batch", "", "height", "width"}));
+        field(graph, 12, valueInfo("output", {-1, channels, -1, -1}, {"batch", "", "height", "width"}));
+
+        std::string opset;
+        field(opset, 2, 13);
+        std::string model;
+        field(model, 1, 7);
+        field(model, 2, std::string("cinnamon-benchmark"));
+        field(model, 7, graph);
+        field(model, 8, opset);
+        return model;
+    }
+
+    // {1, width} -> int64 {2, count}, the indices of the non-zero inputs, so
+    // the output shape depends on the data.
+    inline std::string nonZero() {
+        std::string graph;
+        field(graph, 1, node("NonZero", {"input"}, "output"));
+        field(graph, 2, std::string("nonzero"));
+        field(graph, 11, valueInfo("input", {1, -1}, {"", "width"}));
+        field(graph, 12, valueInfo("output", {2, -1}, {"", "count"}, 7));
+
+        std::string opset;
+        field(opset, 2, 13);
+        std::string model;
+        field(model, 1, 7);
+        field(model, 2, std::string("cinnamon-benchmark"));
+        field(model, 7, graph);
+        field(model, 8, opset);
+        return model;
+    }
+
+    inline void save(const std::string& path, const std::string& bytes) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.write(bytes.data(), bytes.size()))
+            throw std::runtime_error("Cannot write " + path);
+    }
+};
+
+#endif // __CRT_TESTS_ONNX_MODEL_H__
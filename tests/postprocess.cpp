@@ -0,0 +1,204 @@
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <benchmark/benchmark.h>
+
+#include "postprocess.h"
+
+using namespace cinrt::model;
+
+struct Box
+{
+    float x0, y0, x1, y1, score;
+    int cls;
+};
+
+// Typical consumer code: boxes as structs, scalar filter, O(N^2) NMS with division.
+static std::vector<Box> legacyNms(const std::vector<float>& head, size_t anchors, size_t cols, float scoreThreshold, float iouThreshold){
+    std::vector<Box> boxes;
+    for (size_t i = 0; i < anchors; ++i) {
+        const float* row = head.data() + i * cols;
+        int best = 0;
+        for (size_t c = 1; c < cols - 5; ++c)
+            if (row[5 + c] > row[5 + best])
+                best = c;
+        float score = row[4] * row[5 + best];
+        if (score < scoreThreshold)
+            continue;
+        boxes.push_back({row[0] - row[2] / 2, row[1] - row[3] / 2, row[0] + row[2] / 2, row[1] + row[3] / 2, score, best});
+    }
+    std::sort(boxes.begin(), boxes.end(), [](const Box& a, const Box& b){ return a.score > b.score; });
+    std::vector<Box> result;
+    std::vector<bool> removed(boxes.size(), false);
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        if (removed[i])
+            continue;
+        result.push_back(boxes[i]);
+        for (size_t j = i + 1; j < boxes.size(); ++j) {
+            if (removed[j] || boxes[i].cls != boxes[j].cls)
+                continue;
+            float w = std::max(0.f, std::min(boxes[i].x1, boxes[j].x1) - std::max(boxes[i].x0, boxes[j].x0));
+            float h = std::max(0.f, std::min(boxes[i].y1, boxes[j].y1) - std::max(boxes[i].y0, boxes[j].y0));
+            float inter = w * h;
+            float areaI = (boxes[i].x1 - boxes[i].x0) * (boxes[i].y1 - boxes[i].y0);
+            float areaJ = (boxes[j].x1 - boxes[j].x0) * (boxes[j].y1 - boxes[j].y0);
+            if (inter / (areaI + areaJ - inter) > iouThreshold)
+                removed[j] = true;
+        }
+    }
+    return result;
+}
+
+// yolov7 640x640 head: 25200 anchors of [cx, cy, w, h, obj, classes...].
+static std::vector<float> makeHead(size_t anchors, size_t cols, float positives){
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    std::vector<float> head(anchors * cols);
+    for (size_t i = 0; i < anchors; ++i) {
+        float* row = head.data() + i * cols;
+        row[0] = uniform(rng) * 640;
+        row[1] = uniform(rng) * 640;
+        row[2] = 20 + uniform(rng) * 80;
+        row[3] = 20 + uniform(rng) * 80;
+        row[4] = uniform(rng) < positives ? 0.5f + uniform(rng) / 2 : uniform(rng) * 0.1f;
+        for (size_t c = 5; c < cols; ++c)
+            row[c] = uniform(rng);
+    }
+    return head;
+}
+
+// decodeHead and nms must keep exactly the boxes of the legacy code, in order.
+static bool checkDecodeHead(size_t classes){
+    const size_t anchors = 25200, cols = 5 + classes;
+    std::vector<float> head = makeHead(anchors, cols, 0.05f);
+    std::vector<Box> expected = legacyNms(head, anchors, cols, 0.25f, 0.45f);
+    PostprocessOptions options;
+    options.maxDetections = anchors;
+    Detections found = decodeHead(head.data(), 1, anchors, cols, options).front();
+    if (found.size() != expected.size()) {
+        std::cerr << "decodeHead, " << classes << " classes: " << found.size() << " boxes, legacy " << expected.size() << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < expected.size(); ++i) {
+        const Box& box = expected[i];
+        if (found.x0[i] != box.x0 || found.y0[i] != box.y0 || found.x1[i] != box.x1 || found.y1[i] != box.y1
+            || found.score[i] != box.score || found.cls[i] != box.cls) {
+            std::cerr << "decodeHead, " << classes << " classes: box " << i << " differs from legacy" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// decodeRows must route rows by their batch column and undo the letterbox
+// on boxes and landmarks alike.
+static bool checkDecodeRows(){
+    const size_t cols = 22, batchSize = 3;
+    // Row i goes to image i % 4, the fourth image is out of range.
+    std::vector<float> data;
+    for (size_t i = 0; i < 12; ++i) {
+        std::vector<float> row = {float(i % 4), 100.f + i, 200.f + i, 140.f + i, 240.f + i, float(i % 2), 0.9f - i * 0.01f};
+        for (size_t k = 0; k < 5; ++k) {
+            row.push_back(200.f + i + k);
+            row.push_back(300.f + i + k);
+            row.push_back(0.5f);
+        }
+        data.insert(data.end(), row.begin(), row.end());
+    }
+    // 1280x720 in 640x640: scale 0.5, 140 rows of padding on top.
+    Letterbox box = Letterbox::fit(1280, 720, 640, 640);
+    std::vector<Rescale> scales(batchSize, Rescale::letterbox(box, 1280, 720));
+    PostprocessOptions options;
+    options.iouThreshold = 1.f;
+    std::vector<Detections> images = decodeRows(data.data(), data.size() / cols, cols, batchSize, options, scales);
+    const float scale = 0.5f;
+    auto near = [](float a, float b){ return std::fabs(a - b) <= 1e-3f * std::max(1.f, std::fabs(b)); };
+    for (size_t b = 0; b < batchSize; ++b) {
+        const Detections& image = images[b];
+        if (image.size() != 3 || image.numKeypoints != 5) {
+            std::cerr << "decodeRows: image " << b << " has " << image.size() << " boxes" << std::endl;
+            return false;
+        }
+        for (size_t j = 0; j < image.size(); ++j) {
+            // Sorted by decreasing score, so in row order.
+            const float i = float(b + 4 * j);
+            const float* keypoints = image.keypoints.data() + j * 15;
+            bool ok = near(image.x0[j], (100.f + i) / scale) && near(image.y0[j], (200.f + i - 140.f) / scale)
+                && near(image.x1[j], (140.f + i) / scale) && near(image.y1[j], (240.f + i - 140.f) / scale)
+                && image.cls[j] == int(b + 4 * j) % 2;
+            for (size_t k = 0; k < 5; ++k)
+                ok = ok && near(keypoints[3 * k], (200.f + i + k) / scale) && near(keypoints[3 * k + 1], (300.f + i + k - 140.f) / scale)
+                    && keypoints[3 * k + 2] == 0.5f;
+            if (!ok) {
+                std::cerr << "decodeRows: image " << b << ", box " << j << " is misplaced" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void BM_Legacy(benchmark::State& state) {
+    const size_t anchors = 25200, cols = 5 + state.range(1);
+    std::vector<float> head = makeHead(anchors, cols, state.range(0) / 1000.f);
+    for (auto _ : state) {
+        std::vector<Box> boxes = legacyNms(head, anchors, cols, 0.25f, 0.45f);
+        benchmark::DoNotOptimize(boxes.data());
+    }
+}
+
+static void BM_Decode(benchmark::State& state) {
+    const size_t anchors = 25200, cols = 5 + state.range(1);
+    std::vector<float> head = makeHead(anchors, cols, state.range(0) / 1000.f);
+    PostprocessOptions options;
+    options.maxDetections = anchors;
+    std::vector<Rescale> scales = {Rescale::stretch(640, 640, 1920, 1080)};
+    for (auto _ : state) {
+        std::vector<Detections> detections = decodeHead(head.data(), 1, anchors, cols, options, scales);
+        benchmark::DoNotOptimize(detections.data());
+    }
+}
+
+// End-to-end export rows {N, 22}: boxes plus 5 landmarks, batch of 3.
+static void BM_DecodeRows(benchmark::State& state) {
+    const size_t rows = state.range(0), cols = 22;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    std::vector<float> data(rows * cols);
+    for (size_t i = 0; i < rows; ++i) {
+        float* row = data.data() + i * cols;
+        row[0] = i % 3;
+        row[1] = uniform(rng) * 600;
+        row[2] = uniform(rng) * 600;
+        row[3] = row[1] + 20 + uniform(rng) * 40;
+        row[4] = row[2] + 20 + uniform(rng) * 40;
+        row[5] = 0;
+        row[6] = uniform(rng);
+        for (size_t k = 7; k < cols; ++k)
+            row[k] = uniform(rng) * 640;
+    }
+    PostprocessOptions options;
+    options.iouThreshold = 1.f;
+    std::vector<Rescale> scales(3, Rescale::stretch(640, 640, 1920, 1080));
+    for (auto _ : state) {
+        std::vector<Detections> detections = decodeRows(data.data(), rows, cols, 3, options, scales);
+        benchmark::DoNotOptimize(detections.data());
+    }
+}
+
+// Args: positives per thousand anchors, classes.
+BENCHMARK(BM_Legacy)->ArgsProduct({{5, 50, 200}, {1, 80}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Decode)->ArgsProduct({{5, 50, 200}, {1, 80}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DecodeRows)->Arg(100)->Arg(1000)->Unit(benchmark::kMicrosecond);
+
+// Timings of wrong results mean nothing, so the checks run first.
+int main(int argc, char** argv) {
+    if (!checkDecodeHead(1) || !checkDecodeHead(80) || !checkDecodeRows())
+        return 1;
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
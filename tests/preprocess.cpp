@@ -0,0 +1,209 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <opencv2/opencv.hpp>
+#include <benchmark/benchmark.h>
+
+#include "preprocess.h"
+
+using namespace cinrt::model;
+
+// Same layout as mat2vec in utils/image.cpp: [channel][row][col], RGB.
+static std::vector<std::vector<std::vector<float>>> legacyMat2vec(const cv::Mat& image){
+    cv::Mat rgb;
+    cv::cvtColor(image, rgb, cv::COLOR_BGR2RGB);
+    std::vector<std::vector<std::vector<float>>> result(3, std::vector<std::vector<float>>(rgb.rows, std::vector<float>(rgb.cols)));
+    for (int i = 0; i < rgb.rows; ++i) {
+        for (int j = 0; j < rgb.cols; ++j) {
+            cv::Vec3b pixel = rgb.at<cv::Vec3b>(i, j);
+            for (int c = 0; c < 3; ++c) {
+                result[c][i][j] = pixel[c] / 255.0f;
+            }
+        }
+    }
+    return result;
+}
+
+static std::vector<cv::Mat> makeImages(int count){
+    std::vector<cv::Mat> images;
+    for (int i = 0; i < count; ++i) {
+        cv::Mat image(1080, 1920, CV_8UC3);
+        cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+        images.push_back(image);
+    }
+    return images;
+}
+
+// Random interleaved BGR pixels, rows padded to stride bytes.
+static std::vector<uint8_t> makePixels(int height, size_t stride){
+    std::mt19937 rng(7);
+    std::vector<uint8_t> pixels(stride * height);
+    for (uint8_t& pixel : pixels)
+        pixel = static_cast<uint8_t>(rng());
+    return pixels;
+}
+
+// Every SIMD level the CPU has must match the scalar kernel bit for bit,
+// on resized and same-size rows with tails.
+static bool checkSimdLevels(){
+    const int sizes[][4] = {{640, 480, 333, 250}, {257, 131, 257, 131}};
+    for (const auto& size : sizes) {
+        const size_t stride = size[0] * 3 + 5;
+        std::vector<uint8_t> pixels = makePixels(size[1], stride);
+        ImageView view{pixels.data(), size[0], size[1], stride};
+        PreprocessOptions options;
+        options.mean[0] = 0.485f;
+        options.mean[1] = 0.456f;
+        options.mean[2] = 0.406f;
+        options.std[0] = 0.229f;
+        options.std[1] = 0.224f;
+        options.std[2] = 0.225f;
+        options.simd = SimdLevel::Scalar;
+        std::vector<float> expected(size[2] * size[3] * 3);
+        imageToTensor(view, expected.data(), size[2], size[3], options);
+        for (int level = 1; level <= static_cast<int>(detectSimd()); ++level) {
+            options.simd = static_cast<SimdLevel>(level);
+            std::vector<float> found(expected.size());
+            imageToTensor(view, found.data(), size[2], size[3], options);
+            for (size_t i = 0; i < expected.size(); ++i) {
+                if (std::memcmp(&found[i], &expected[i], sizeof(float)) != 0) {
+                    std::cerr << "SIMD level " << level << " differs from scalar at " << i << ": " << found[i] << " != " << expected[i] << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Bilinear sample with half-pixel centers and clamped edges, in doubles.
+static double bilinear(const std::vector<uint8_t>& pixels, int width, int height, size_t stride, double x, double y, int c){
+    x = std::min(std::max(x, 0.0), width - 1.0);
+    y = std::min(std::max(y, 0.0), height - 1.0);
+    int x0 = static_cast<int>(x), y0 = static_cast<int>(y);
+    int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+    double fx = x - x0, fy = y - y0;
+    auto at = [&](int px, int py){ return double(pixels[py * stride + 3 * px + c]); };
+    return (at(x0, y0) * (1 - fx) + at(x1, y0) * fx) * (1 - fy) + (at(x0, y1) * (1 - fx) + at(x1, y1) * fx) * fy;
+}
+
+// The fused resize must stay within one 8-bit level of an exact bilinear
+// resize, and a letterbox must fill exactly the pad value around it.
+static bool checkResize(bool letterbox){
+    const int width = 1920, height = 1080, size = 640;
+    const size_t stride = width * 3;
+    std::vector<uint8_t> pixels = makePixels(height, stride);
+    ImageView view{pixels.data(), width, height, stride};
+    Letterbox box = letterbox ? Letterbox::fit(width, height, size, size) : Letterbox{1.f, size, size, 0, 0};
+    std::vector<float> found(size * size * 3);
+    if (letterbox)
+        letterboxToTensor(view, found.data(), size, size, box);
+    else
+        imageToTensor(view, found.data(), size, size);
+    for (int c = 0; c < 3; ++c) {
+        const float* plane = found.data() + c * size * size;
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                const float value = plane[y * size + x];
+                const int bx = x - box.padX, by = y - box.padY;
+                if (bx < 0 || by < 0 || bx >= box.width || by >= box.height) {
+                    if (std::fabs(value - 114 / 255.f) > 1e-6f) {
+                        std::cerr << "Letterbox pad at " << x << ", " << y << " is " << value << std::endl;
+                        return false;
+                    }
+                    continue;
+                }
+                // Output RGB plane c samples BGR channel 2 - c.
+                double expected = bilinear(pixels, width, height, stride,
+                    (bx + 0.5) * width / box.width - 0.5, (by + 0.5) * height / box.height - 0.5, 2 - c) / 255;
+                if (std::fabs(value - expected) > 1.0 / 255 + 1e-6) {
+                    std::cerr << (letterbox ? "Letterbox" : "Resize") << " at " << x << ", " << y << " is " << value << ", bilinear " << expected << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// The test_wb / yolov7 path: resize, nested vectors, concatenate, flatten.
+static void BM_Legacy(benchmark::State& state) {
+    const int size = state.range(0);
+    std::vector<cv::Mat> images = makeImages(3);
+    std::vector<float> input(size * size * 3 * 3);
+    for (auto _ : state) {
+        std::vector<std::vector<std::vector<float>>> inputMatrix;
+        for (const cv::Mat& image : images) {
+            cv::Mat resized;
+            cv::resize(image, resized, cv::Size(size, size));
+            std::vector<std::vector<std::vector<float>>> vec = legacyMat2vec(resized);
+            inputMatrix.insert(inputMatrix.end(), vec.begin(), vec.end());
+        }
+        size_t index = 0;
+        for (int c = 0; c < 3 * 3; ++c) {
+            for (int i = 0; i < size; ++i) {
+                for (int j = 0; j < size; ++j) {
+                    input[index] = inputMatrix[c][i][j];
+                    index++;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(input.data());
+    }
+}
+
+static void BM_Fused(benchmark::State& state) {
+    const int size = state.range(0);
+    PreprocessOptions options;
+    options.simd = static_cast<SimdLevel>(state.range(1));
+    if (options.simd > detectSimd()) {
+        state.SkipWithError("Instruction set not supported");
+        return;
+    }
+    std::vector<cv::Mat> images = makeImages(3);
+    std::vector<ImageView> views;
+    for (const cv::Mat& image : images)
+        views.push_back({image.data, image.cols, image.rows, image.step});
+    std::vector<float> input(size * size * 3 * 3);
+    for (auto _ : state) {
+        imagesToTensor(views, input.data(), size, size, options);
+        benchmark::DoNotOptimize(input.data());
+    }
+}
+
+// Layout conversion alone, images already at the input size.
+static void BM_Convert(benchmark::State& state) {
+    const int size = state.range(0);
+    PreprocessOptions options;
+    options.simd = static_cast<SimdLevel>(state.range(1));
+    if (options.simd > detectSimd()) {
+        state.SkipWithError("Instruction set not supported");
+        return;
+    }
+    cv::Mat image(size, size, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    ImageView view{image.data, image.cols, image.rows, image.step};
+    std::vector<float> input(size * size * 3);
+    for (auto _ : state) {
+        imageToTensor(view, input.data(), size, size, options);
+        benchmark::DoNotOptimize(input.data());
+    }
+    state.SetBytesProcessed(state.iterations() * size * size * 3);
+}
+
+BENCHMARK(BM_Legacy)->Arg(256)->Arg(640)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Fused)->ArgsProduct({{256, 640}, {0, 1, 2, 3}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Convert)->ArgsProduct({{256, 640}, {0, 1, 2, 3}})->Unit(benchmark::kMicrosecond);
+
+// Timings of wrong results mean nothing, so the checks run first.
+int main(int argc, char** argv) {
+    if (!checkSimdLevels() || !checkResize(false) || !checkResize(true))
+        return 1;
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}